@@ -2,13 +2,22 @@
 #include <opencv2/opencv.hpp>
 
 namespace sls {
+    // Reshape D x numPoints descriptors (one column per grid point, row-major
+    // over an s1 x s2 grid) into an s2 x s1 image with D channels, the layout
+    // computeDenseFlowLocal expects.
+    cv::Mat gridDescriptorsToImage(const cv::Mat& desc, int s1, int s2);
+
     cv::Mat computeDenseFlowLocal(
         const cv::Mat& sourceDesc,
         const cv::Mat& targetDesc,
         int windowRadius = 5
     );
 
+    // Colour-wheel visualisation as CV_8UC3 BGR: hue is the flow direction
+    // over the full circle, brightness saturates at 10 px.
     cv::Mat flowToColor(const cv::Mat& flow);
+
+    // target sampled at (x, y) + flow(x, y), bilinear.
     cv::Mat warpImage(const cv::Mat& target, const cv::Mat& flow);
 
     // Result struct for evaluation
@@ -17,12 +26,21 @@ namespace sls {
         double medianError;
         double percentBelow2px;
         double percentBelow5px;
-        int    numSamples;
+        int    numSamples;      // scored samples
+        double validFraction;   // share of the sampled pixels that were scored
     };
 
+    // Endpoint error against H on every step-th pixel, computed in parallel
+    // row bands. The median is exact (selection over all sampled errors).
+    // When `errors` is given, every scored endpoint error is appended to
+    // it, e.g. to take statistics over several flows. A non-empty `valid`
+    // (CV_8UC1, flow size) restricts scoring to its non-zero pixels, e.g.
+    // those whose correspondence under H lies inside the target image.
     FlowEvalResult evaluateFlowAgainstHomography(
         const cv::Mat& flow,
         const cv::Mat& H,
-        int step = 4
+        int step = 4,
+        std::vector<float>* errors = nullptr,
+        const cv::Mat& valid = cv::Mat()
     );
 }
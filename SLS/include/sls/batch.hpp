@@ -0,0 +1,109 @@
+#pragma once
+#include <opencv2/core.hpp>
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include "sls_options.hpp"
+#include "flow_sgm.hpp"
+
+namespace sls {
+
+    // Flow stage settings for batch processing.
+    struct FlowOptions {
+        bool      enabled;
+        bool      regularize;     // computeDenseFlowSGM instead of computeDenseFlowLocal
+        int       windowRadius;   // in grid cells
+        SGMParams sgm;
+        bool      upsample;       // upsample grid flow to the (scaled) image resolution
+        float     sigmaRange;     // guide sigma for upsampleFlow
+
+        FlowOptions()
+            : enabled(false),
+            regularize(false),
+            windowRadius(5),
+            upsample(true),
+            sigmaRange(12.0f)
+        {
+        }
+    };
+
+    // Everything a headless run needs; loaded from a YAML/JSON options file.
+    struct BatchOptions {
+        SLSOptions  sls;
+        bool        useSLS;        // "sls" (PCA + scale averaging) or "dsift"
+        double      scaleFactor;   // ingest resize factor
+        FlowOptions flow;
+        bool        crossCheck;    // keep mutual nearest neighbours only
+        float       ratio;         // nearest / second-nearest test, 0 disables
+        int         maxMatches;    // 0 keeps all matches
+        int         memoryBudgetMB; // extraction memory budget, 0 = unlimited
+
+        bool writeDescriptors;
+        bool writeFlow;
+        bool writeFlowColor;
+        bool writeMatches;
+
+        BatchOptions();
+    };
+
+    struct PairEntry {
+        std::string source;
+        std::string target;
+        std::string name;   // output file stem
+    };
+
+    struct PairTiming {
+        double loadMs;
+        double extractMs;
+        double flowMs;
+        double matchMs;
+        double writeMs;
+        double totalMs;
+    };
+
+    struct PairResult {
+        bool        ok;
+        std::string error;
+        PairTiming  timing;
+        int         numPoints1;
+        int         numPoints2;
+        int         numMatches;
+    };
+
+    // Options file layout (cv::FileStorage, any missing key keeps its default):
+    //   mode: sls | dsift        scaleFactor: 0.25        crossCheck: 1     ratio: 0
+    //   memoryBudgetMB: 0
+    //   sls:     { preset: light | paper, sigma: [..], gridSpacing, dimReduction,
+    //              dimReductionCov, subsDim, octaveSigma }
+    //   flow:    { enabled, regularize, windowRadius, P1, P2, numPaths, maxVolumeMB,
+    //              upsample, sigmaRange }
+    //   outputs: { descriptors, flow, flowColor, matches, maxMatches }
+    bool loadBatchOptions(const std::string& path, BatchOptions& opts);
+
+    // Same layout, read from an in-memory YAML/JSON string. An empty string
+    // leaves the defaults untouched.
+    bool parseBatchOptions(const std::string& text, BatchOptions& opts);
+
+    // Manifest: one pair per line, "source target [name]". Blank lines and
+    // lines starting with '#' are skipped. Missing names become pair_<index>.
+    bool loadPairManifest(const std::string& path, std::vector<PairEntry>& pairs);
+
+    // Grid flow from desc1 to desc2 per opts.flow, upsampled to the size of
+    // `guide` when opts.flow.upsample is set. Empty if the grids differ.
+    cv::Mat computePairFlow(const cv::Mat& desc1,
+        const cv::Mat& desc2,
+        const cv::Size& grid1,
+        const cv::Size& grid2,
+        const cv::Mat& guide,
+        const BatchOptions& opts);
+
+    // Run one pair end to end without any GUI and write the selected outputs
+    // under outDir as <name>.desc.yml.gz, <name>.flo, <name>_flow.png and
+    // <name>.matches.csv.
+    PairResult processPair(const PairEntry& pair,
+        const BatchOptions& opts,
+        const std::string& outDir);
+
+    // One JSON object per line with the per-stage timings of a pair.
+    void writeTimingJson(std::ostream& os, const PairEntry& pair, const PairResult& res);
+}
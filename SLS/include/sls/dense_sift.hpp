@@ -1,5 +1,6 @@
 #pragma once
 #include <opencv2/core.hpp>
+#include <opencv2/features2d.hpp>
 #include <vector>
 #include "sls_options.hpp"
 
@@ -9,4 +10,75 @@ struct DescriptorGrid {
     int s1, s2;
 };
 
+// 8-bit grayscale image with the reflected border generateDescriptors needs.
+// Build it once per image and share it between DSIFT and SLS.
+struct PaddedImage {
+    cv::Mat padded;  // CV_8UC1
+    int padSize;
+    // Octave mode only: octaves[o - 1] is the image pyrDown'ed o times with
+    // its own reflected border octavePads[o - 1].
+    std::vector<cv::Mat> octaves;
+    std::vector<int> octavePads;
+};
+
+// Border of the full-resolution image: what its largest full-resolution
+// scale needs (every scale unless opts.octaveSigma is set).
+int descriptorPadSize(const SLSOptions& opts);
+
+// Octave a scale is computed on; 0 is full resolution.
+int descriptorOctave(float sigma, const SLSOptions& opts);
+
+// Border of octave o >= 1: what the scales computed on it need, in octave
+// pixels.
+int octavePadSize(int octave, const SLSOptions& opts);
+
+// Pixels around a grid keypoint of scale sigma (in pixels of the image SIFT
+// runs on) that cv::SIFT::compute reads: the sampling radius of its
+// descriptor, 3 * (size / 2) * sqrt(2) * (4 + 1) / 2 or about 80 sigma for
+// the dense-grid patch size, plus centre rounding, the gradient and the
+// base blur SIFT applies to its whole input. Rows further away than this
+// can be cropped without changing the descriptors.
+int descriptorReach(float sigma, double siftSigma = 1.6);
+PaddedImage padForDescriptors(const cv::Mat& grayImage, const SLSOptions& opts);
+
 DescriptorGrid generateDescriptors(const cv::Mat& grayImage, const SLSOptions& opts);
+
+// Same as above but reuses a caller-owned SIFT instance instead of creating
+// one per call (long-running callers keep it warm).
+DescriptorGrid generateDescriptors(const cv::Mat& grayImage,
+    const SLSOptions& opts,
+    const cv::Ptr<cv::SIFT>& sift);
+
+DescriptorGrid generateDescriptors(const PaddedImage& image,
+    const SLSOptions& opts,
+    const cv::Ptr<cv::SIFT>& sift);
+
+// Descriptors (points.size() x 128, CV_32F) of one scale at arbitrary
+// points of a padded 8-bit image, with the dense-grid patch size.
+cv::Mat siftAtPoints(const cv::Mat& padded,
+    const std::vector<cv::Point2f>& points,
+    float sigma,
+    const cv::Ptr<cv::SIFT>& sift);
+
+// Same for points in image.padded coordinates, on the octave
+// descriptorOctave picks. SIFT only sees the rows the patches cover. Points
+// that fall between octave pixels blend the descriptors of the surrounding
+// octave pixels bilinearly.
+cv::Mat siftAtScale(const PaddedImage& image,
+    const std::vector<cv::Point2f>& points,
+    float sigma,
+    const SLSOptions& opts,
+    const cv::Ptr<cv::SIFT>& sift);
+
+// Only grid rows [rowBegin, rowEnd) (s2 = rowEnd - rowBegin); SIFT runs on
+// the matching band of the padded image, so memory follows the band height.
+DescriptorGrid generateDescriptorRows(const PaddedImage& image,
+    const SLSOptions& opts,
+    const cv::Ptr<cv::SIFT>& sift,
+    int rowBegin,
+    int rowEnd);
+
+// Average descriptors across scales for each grid point.
+// dp: D x (numPoints * numSigma), column layout = si + i * numSigma
+// Returns: D x numPoints
+cv::Mat averageAcrossScales(const cv::Mat& dp, int numPoints, int numSigma);
@@ -0,0 +1,104 @@
+#pragma once
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "sls_options.hpp"
+#include "dense_sift.hpp"
+#include "sls_extractor.hpp"
+
+namespace sls {
+
+    struct CacheParams {
+        std::string dir;        // cache root; may be shared by several processes
+        int64_t     maxBytes;   // least recently used entries go beyond this
+
+        CacheParams()
+            : maxBytes(int64_t(2048) << 20)
+        {
+        }
+    };
+
+    struct CacheStats {
+        int64_t entries;
+        int64_t bytes;
+        int64_t hits;
+        int64_t misses;
+        int64_t evictions;
+    };
+
+    // Content-addressed on-disk store for extraction results. Keys are
+    // 128-bit hashes of the image pixels (after decode and resize) combined
+    // with the options the result depends on:
+    //   grid:  image + sigma + gridSpacing + octaveSigma + SIFT -> DescriptorGrid
+    //   pair:  both images + every SLSOptions field  -> SLSOutput (the joint
+    //          PCA basis follows from these)
+    //   desc:  image + sigma + gridSpacing + basis   -> reduced, scale-averaged
+    //          descriptors under a fixed PCA basis
+    // Every key also covers CV_VERSION and the SIFT parameters (pair and desc
+    // entries are always computed with SIFT::create()), so upgrading OpenCV
+    // or passing a differently configured SIFT never returns old values.
+    // Entries are single files written atomically; a file's mtime is its
+    // last use, so recency survives restarts and is shared between processes.
+    class DescriptorCache {
+    public:
+        explicit DescriptorCache(const CacheParams& params);
+
+        static std::string imageKey(const cv::Mat& image);
+        static std::string basisKey(const cv::Mat& pcaBasis);   // empty basis: no reduction
+        // `sift` is the instance the grid is computed with; empty means
+        // SIFT::create().
+        static std::string gridKey(const std::string& imageKey,
+            const SLSOptions& opts,
+            const cv::Ptr<cv::SIFT>& sift = cv::Ptr<cv::SIFT>());
+        static std::string pairKey(const std::string& imageKey1,
+            const std::string& imageKey2,
+            const SLSOptions& opts);
+        static std::string descKey(const std::string& imageKey,
+            const SLSOptions& opts,
+            const std::string& basisKey);
+
+        bool loadGrid(const std::string& key, DescriptorGrid& grid);
+        void storeGrid(const std::string& key, const DescriptorGrid& grid);
+
+        bool loadPair(const std::string& key, SLSOutput& out);
+        void storePair(const std::string& key, const SLSOutput& out);
+
+        bool loadDesc(const std::string& key, cv::Mat& desc, cv::Size& grid);
+        void storeDesc(const std::string& key, const cv::Mat& desc, const cv::Size& grid);
+
+        // Re-read the directory and evict down to the size limit.
+        void trim();
+        void clear();
+        CacheStats stats();
+        const CacheParams& params() const { return cacheParams; }
+
+    private:
+        struct Entry {
+            int64_t bytes;
+            int64_t lastUse;
+        };
+
+        std::string pathFor(const std::string& key, const char* kind) const;
+        bool readEntry(const std::string& key, const char* kind, std::string& data);
+        void writeEntry(const std::string& key, const char* kind, const std::string& data);
+        void rescanLocked();
+        void evictLocked();
+
+        CacheParams cacheParams;
+        std::mutex  mtx;
+        std::map<std::string, Entry> entries;   // by path
+        int64_t     totalBytes;
+        int64_t     hits, misses, evictions;
+        int         storesSinceScan;
+    };
+
+    // Process-wide cache consulted by generateDescriptors and
+    // extractScalelessDescs. Disabled unless enabled here or through the
+    // SLS_CACHE_DIR (and optional SLS_CACHE_MB) environment variables.
+    void enableDescriptorCache(const CacheParams& params);
+    void disableDescriptorCache();
+    std::shared_ptr<DescriptorCache> descriptorCache();
+}
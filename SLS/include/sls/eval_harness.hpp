@@ -0,0 +1,97 @@
+#pragma once
+#include <opencv2/core.hpp>
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include "sls_options.hpp"
+#include "FlowUtils.hpp"
+#include "flow_sgm.hpp"
+
+namespace sls {
+
+    // One extractor + flow configuration to evaluate.
+    struct EvalConfig {
+        std::string name;
+        SLSOptions  opts;
+        bool        useSLS;        // PCA + scale averaging (SLS) or scale-averaged DSIFT
+        bool        regularize;    // computeDenseFlowSGM instead of computeDenseFlowLocal
+        int         windowRadius;  // search radius in grid cells
+        SGMParams   sgm;
+
+        EvalConfig()
+            : useSLS(true),
+            regularize(false),
+            windowRadius(5)
+        {
+        }
+    };
+
+    // Ranges for the random homographies applied to each input image.
+    struct HomographySampling {
+        double maxLog2Scale;    // scale drawn from 2^[-max, max]
+        double maxRotationDeg;
+        double maxPerspective;  // h20 * width and h21 * height drawn from [-max, max]
+        double maxShiftFrac;    // translation as a fraction of the image size
+
+        HomographySampling()
+            : maxLog2Scale(0.5),
+            maxRotationDeg(15.0),
+            maxPerspective(0.1),
+            maxShiftFrac(0.05)
+        {
+        }
+    };
+
+    struct EvalParams {
+        int                pairsPerImage;
+        unsigned           seed;
+        int                evalStep;  // pixel stride for evaluateFlowAgainstHomography
+        HomographySampling sampling;
+
+        EvalParams()
+            : pairsPerImage(3),
+            seed(1234u),
+            evalStep(4)
+        {
+        }
+    };
+
+    // Aggregated accuracy and cost of one configuration over all pairs.
+    // Every accuracy figure is taken over the samples of all pairs together,
+    // counting only pixels whose true correspondence lies inside the warped
+    // image (accuracy.validFraction of those sampled).
+    struct EvalRecord {
+        std::string    config;
+        int            pairs;
+        FlowEvalResult accuracy;
+        double         wallMs;         // extraction + flow + upsampling, all pairs
+        double         pointsPerSec;   // descriptor grid points processed per second
+        double         descriptorMB;   // largest per-pair descriptor footprint
+        double         peakRssMB;      // peak resident set while this config ran;
+                                       // negative where it cannot be reset
+    };
+
+    // Random homography about the image centre within the given ranges.
+    cv::Mat randomHomography(const cv::Size& size,
+        const HomographySampling& sampling,
+        cv::RNG& rng);
+
+    // Warp every image with random homographies, run each configuration on
+    // the (image, warped) pairs and score the upsampled flow against the
+    // known ground truth wherever it points inside the warped image.
+    std::vector<EvalRecord> runSyntheticEval(const std::vector<cv::Mat>& images,
+        const std::vector<EvalConfig>& configs,
+        const EvalParams& params = EvalParams());
+
+    void printEvalReport(std::ostream& os, const std::vector<EvalRecord>& records);
+    void writeEvalCsv(std::ostream& os, const std::vector<EvalRecord>& records);
+
+    // Peak resident set size of this process in bytes, 0 if unavailable.
+    size_t peakResidentBytes();
+
+    // Restart the peak at the current resident set, so that
+    // peakResidentBytes covers only what runs afterwards. Only Linux
+    // supports this; elsewhere returns false and the peak stays
+    // process-wide.
+    bool resetPeakResident();
+}
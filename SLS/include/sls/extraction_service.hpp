@@ -0,0 +1,91 @@
+#pragma once
+#include <opencv2/core.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sls {
+
+    struct ServiceParams {
+        std::string socketPath;   // Unix-domain socket (AF_UNIX, also on Windows 10+)
+        int         maxBatch;     // requests with the same options processed together
+        int         batchWaitMs;  // how long the dispatcher waits to fill a batch
+        int         maxWarm;      // options strings kept warm; least recently used go
+
+        ServiceParams()
+            : maxBatch(8),
+            batchWaitMs(5),
+            maxWarm(16)
+        {
+        }
+    };
+
+    // One pair request. `options` uses the batch options file layout
+    // (see loadBatchOptions) and doubles as the warm-state key; images are
+    // encoded bytes (JPEG, PNG, ...) as read from disk.
+    struct ServiceRequest {
+        std::string        options;
+        std::vector<uchar> image1;
+        std::vector<uchar> image2;
+    };
+
+    struct ServiceReply {
+        bool        ok;
+        std::string error;
+        cv::Mat     desc1;      // D x numPoints
+        cv::Mat     desc2;
+        cv::Mat     flow;       // empty unless flow is enabled in the options
+        cv::Mat     pcaBasis;   // basis shared by every request with these options
+        cv::Size    grid1;
+        cv::Size    grid2;
+        double      serverMs;   // time spent in the batch that served the request
+        int         batchSize;
+
+        ServiceReply() : ok(false), serverMs(0.0), batchSize(0) {}
+    };
+
+    // Long-running extraction service. Keeps per-options warm state (SIFT
+    // instances, the PCA basis fitted on the first batch) across requests and
+    // groups concurrent requests that share options into one batch whose
+    // images are extracted in parallel.
+    //
+    // The PCA basis is fitted on the images of the first batch served for an
+    // options string and then frozen, so reduced descriptors depend on which
+    // requests arrived first, and a pair sent to the service generally
+    // differs from extractScalelessDescs on the same pair (which fits its own
+    // joint basis). Every reply carries the basis it was projected on. Warm
+    // state evicted beyond params.maxWarm is refitted on its next batch.
+    class ExtractionService {
+    public:
+        explicit ExtractionService(const ServiceParams& params);
+        ~ExtractionService();
+
+        // Listen on params.socketPath and serve until stop(). Returns false if
+        // the socket could not be set up.
+        bool run();
+        void stop();
+
+        // In-process entry point; blocks until the batch holding the request
+        // has been processed. Failures, including exceptions thrown while
+        // processing the batch, come back as ok == false with an error.
+        ServiceReply submit(const ServiceRequest& request);
+
+    private:
+        struct Impl;
+        std::unique_ptr<Impl> impl;
+    };
+
+    // Minimal blocking client for ExtractionService.
+    class ServiceClient {
+    public:
+        ServiceClient();
+        ~ServiceClient();
+
+        bool connect(const std::string& socketPath);
+        bool request(const ServiceRequest& request, ServiceReply& reply);
+        void close();
+
+    private:
+        long long fd;
+    };
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <opencv2/core.hpp>
+
+namespace sls {
+
+    // Parameters for the regularized (semi-global) flow mode.
+    struct SGMParams {
+        int   windowRadius;  // search radius, same meaning as in computeDenseFlowLocal
+        float P1;            // penalty for a one-step change of displacement
+        float P2;            // penalty for any larger jump
+        int   numPaths;      // aggregation directions: 4 or 8
+        int   maxVolumeMB;   // larger cost volumes are refused; 0 = no limit
+
+        // Non-positive penalties are derived from the mean matching cost.
+        SGMParams()
+            : windowRadius(5),
+            P1(-1.0f),
+            P2(-1.0f),
+            numPaths(8),
+            maxVolumeMB(2048)
+        {
+        }
+    };
+
+    // Regularized alternative to computeDenseFlowLocal. Builds the window
+    // cost volume once and aggregates it along numPaths scanline directions
+    // with SGM-style smoothness penalties before picking the displacement.
+    // Runs in O(pixels x candidates) per direction. Inputs and output have
+    // the same layout as computeDenseFlowLocal.
+    // Memory is two 16-bit volumes (4 bytes per pixel and candidate; costs
+    // are quantised after sampling their range on a strided subset). Returns
+    // an empty Mat when that exceeds params.maxVolumeMB.
+    cv::Mat computeDenseFlowSGM(
+        const cv::Mat& sourceDesc,
+        const cv::Mat& targetDesc,
+        const SGMParams& params = SGMParams()
+    );
+}
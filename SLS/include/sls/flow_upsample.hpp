@@ -0,0 +1,27 @@
+#pragma once
+#include <opencv2/core.hpp>
+
+namespace sls {
+
+    // Parameters for guided (joint-bilateral) flow upsampling.
+    struct FlowUpsampleParams {
+        int   gridSpacing;  // pixel distance between grid nodes (SLSOptions::gridSpacing)
+        int   radius;       // support of the spatial tent, in grid nodes
+        float sigmaRange;   // guide intensity sigma, on the 0..255 scale
+
+        FlowUpsampleParams()
+            : gridSpacing(1),
+            radius(1),
+            sigmaRange(12.0f)
+        {
+        }
+    };
+
+    // Convert a grid flow (s2 x s1, CV_32FC2, displacement in grid cells)
+    // into a per-pixel flow the size of `guide` (CV_32FC2, displacement in
+    // pixels). Grid node (i, j) sits on pixel (j * gridSpacing, i * gridSpacing),
+    // matching the layout produced by generateDescriptors.
+    cv::Mat upsampleFlow(const cv::Mat& gridFlow,
+        const cv::Mat& guide,
+        const FlowUpsampleParams& params = FlowUpsampleParams());
+}
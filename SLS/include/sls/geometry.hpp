@@ -0,0 +1,58 @@
+#pragma once
+#include <opencv2/core.hpp>
+#include <opencv2/features2d.hpp>
+#include <vector>
+
+namespace sls {
+
+    enum class GeometryModel {
+        Homography,   // 8 dof, 4-point samples
+        Affine,       // 6 dof, 3-point samples
+        Similarity    // 4 dof (rotation, uniform scale, translation), 2-point samples
+    };
+
+    struct RansacParams {
+        double   reprojThreshold;  // inlier threshold in pixels
+        double   confidence;       // adaptive termination confidence
+        int      maxIterations;
+        int      batchSize;        // hypotheses scored in parallel per round
+        unsigned seed;
+
+        RansacParams()
+            : reprojThreshold(3.0),
+            confidence(0.995),
+            maxIterations(20000),
+            batchSize(64),
+            seed(0x5151u)
+        {
+        }
+    };
+
+    struct GeometryResult {
+        cv::Mat model;                  // 3x3 CV_64F, last row (0 0 1) for affine/similarity
+        std::vector<uchar> inlierMask;  // one entry per correspondence
+        int  numInliers;
+        int  iterations;
+        bool success;
+    };
+
+    // Robustly fit `model` mapping src -> dst. `quality` holds one score per
+    // correspondence where lower is better (e.g. match distance); when given,
+    // sampling follows PROSAC and draws from the best-ranked matches first.
+    // Hypotheses are scored in parallel batches and the loop stops as soon as
+    // the standard RANSAC confidence bound is met.
+    GeometryResult estimateGeometry(const std::vector<cv::Point2f>& src,
+        const std::vector<cv::Point2f>& dst,
+        const std::vector<float>& quality,
+        GeometryModel model,
+        const RansacParams& params = RansacParams());
+
+    // Convert matches between two keypoint sets into point lists plus match
+    // distances, ready for estimateGeometry.
+    void matchesToCorrespondences(const std::vector<cv::DMatch>& matches,
+        const std::vector<cv::KeyPoint>& kp1,
+        const std::vector<cv::KeyPoint>& kp2,
+        std::vector<cv::Point2f>& src,
+        std::vector<cv::Point2f>& dst,
+        std::vector<float>& quality);
+}
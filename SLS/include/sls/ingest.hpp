@@ -0,0 +1,19 @@
+#pragma once
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+
+namespace sls {
+
+    // Load an image as 8-bit grayscale scaled by scaleFactor. For JPEG input,
+    // when the factor allows it, the decoder reduces resolution itself (DCT
+    // scaling by 1/2, 1/4 or 1/8) and only the remainder is resized with
+    // INTER_AREA. Because reduced decoding rounds up, sizes can then differ
+    // from a full decode followed by cv::resize by at most one pixel. Other
+    // formats are always fully decoded and resized, since OpenCV's reduced
+    // modes for them subsample rather than filter.
+    cv::Mat loadGrayscale(const std::string& path, double scaleFactor = 1.0);
+
+    // Same for an encoded image already in memory.
+    cv::Mat decodeGrayscale(const std::vector<uchar>& buffer, double scaleFactor = 1.0);
+}
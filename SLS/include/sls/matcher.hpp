@@ -0,0 +1,67 @@
+#pragma once
+#include <opencv2/core.hpp>
+#include <vector>
+
+namespace sls {
+
+    struct MatcherParams {
+        int   k;           // neighbours kept per descriptor, in both directions
+        bool  mutual;      // keep only mutual nearest neighbours (BFMatcher crossCheck)
+        float ratio;       // nearest / second-nearest distance ratio; 0 disables
+        int   blockRows;   // descriptors of set 1 per GEMM block
+        int   blockCols;   // descriptors of set 2 per GEMM block
+        int   scratchMB;   // cap on the per-band backward lists (fewer bands beyond it)
+
+        MatcherParams()
+            : k(2),
+            mutual(true),
+            ratio(0.0f),
+            blockRows(64),
+            blockCols(256),
+            scratchMB(256)
+        {
+        }
+    };
+
+    // Top-k neighbours of every descriptor of one set in the other set,
+    // nearest first. Rows with fewer than k candidates are padded with
+    // index -1 and distance FLT_MAX.
+    struct NeighbourTable {
+        cv::Mat indices;    // N x k, CV_32S
+        cv::Mat distances;  // N x k, CV_32F, L2 distance
+    };
+
+    // Brute-force L2 k-nearest-neighbour search between two descriptor sets
+    // in the SLSOutput layout (D x numPoints). Distances are evaluated as
+    // |a|^2 + |b|^2 - 2 a.b over cache-sized GEMM blocks, and every block
+    // updates the running top-k of its rows (forward) and of its columns
+    // (backward) in the same pass, so both directions cost one distance
+    // computation. Row bands run in parallel, one per thread, each with
+    // private backward lists of N2 x k entries; params.scratchMB caps their
+    // total by running fewer bands. The expanded form carries float
+    // rounding of order 1e-7 |a|^2, so candidates closer together than that
+    // may be ordered differently than by a direct evaluation.
+    void knnMatchBidirectional(const cv::Mat& desc1,
+        const cv::Mat& desc2,
+        NeighbourTable& forward,
+        NeighbourTable& backward,
+        const MatcherParams& params = MatcherParams());
+
+    // Nearest-neighbour matches from desc1 (query) to desc2 (train), filtered
+    // by the mutual check and the ratio test from a single
+    // knnMatchBidirectional pass. The top candidates of that pass (k plus a
+    // few extra) are re-ranked in both directions with directly computed
+    // distances before the checks, so with the defaults the result is that
+    // of BFMatcher(NORM_L2, true).match on the transposed descriptors unless
+    // the true neighbour falls outside that window through rounding, which
+    // needs several near-ties within float precision.
+    std::vector<cv::DMatch> matchDescriptors(const cv::Mat& desc1,
+        const cv::Mat& desc2,
+        const MatcherParams& params = MatcherParams());
+
+    // Working memory of matchDescriptors beyond its inputs on `threads`
+    // threads (row-major copies, neighbour tables, band lists, GEMM blocks),
+    // for memory planning.
+    size_t matchingWorkBytes(long long N1, long long N2, int D,
+        const MatcherParams& params = MatcherParams(), int threads = 1);
+}
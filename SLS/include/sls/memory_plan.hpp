@@ -0,0 +1,74 @@
+#pragma once
+#include <opencv2/core.hpp>
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include "sls_options.hpp"
+#include "sls_extractor.hpp"
+
+namespace sls {
+
+    struct MemoryPlanParams {
+        size_t budgetBytes;   // 0 = unlimited
+        int    maxThreads;    // 0 = cv::getNumThreads()
+        bool   subspace;      // include computeSLSDescriptors (8256 floats per point)
+        bool   matching;      // include matchDescriptors on the outputs
+
+        MemoryPlanParams()
+            : budgetBytes(0),
+            maxThreads(0),
+            subspace(false),
+            matching(true)
+        {
+        }
+    };
+
+    // Bytes live at the peak of one stage, including everything earlier
+    // stages still hold.
+    struct StageMemory {
+        std::string name;
+        size_t      bytes;
+    };
+
+    struct MemoryPlan {
+        std::vector<StageMemory> stages;   // whole-image extraction, as extractScalelessDescs runs it
+        size_t peakBytes;                  // max over stages
+        size_t budgetBytes;
+
+        // Recommended execution. tileRows == 0 means the whole-image path
+        // fits; otherwise extraction runs in bands of tileRows grid rows,
+        // `threads` bands at a time, with the stages in tiledStages.
+        int    tileRows;
+        int    threads;
+        std::vector<StageMemory> tiledStages;
+        size_t tiledPeakBytes;
+        bool   fits;
+
+        cv::Size grid1, grid2;             // descriptor grids (s1 x s2)
+    };
+
+    // Predict the footprint of extracting SLS descriptors for a pair of
+    // (already scaled) images of the given sizes and pick a tiling and
+    // thread count that stays within params.budgetBytes. Estimates follow
+    // the allocations the pipeline makes (descriptor matrices, PCA copies,
+    // SIFT scale space); small per-point bookkeeping is not counted.
+    MemoryPlan planMemory(const SLSOptions& opts,
+        const cv::Size& imageSize1,
+        const cv::Size& imageSize2,
+        const MemoryPlanParams& params = MemoryPlanParams());
+
+    void printMemoryPlan(std::ostream& os, const MemoryPlan& plan);
+
+    // extractScalelessDescs that honours a memory budget: the whole-image
+    // path when it fits, otherwise banded extraction as planned. Bands give
+    // the same grid descriptors as the whole image, and the PCA basis is
+    // fitted on all of them from moments accumulated band by band, so the
+    // output matches extractScalelessDescs up to rounding and the sign of
+    // each PCA component. Returns an empty output (and says why) when not
+    // even a single-row band fits.
+    SLSOutput extractScalelessDescsWithinBudget(const cv::Mat& I1,
+        const cv::Mat& I2,
+        const SLSOptions& opts,
+        const MemoryPlanParams& params);
+}
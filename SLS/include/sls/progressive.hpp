@@ -0,0 +1,79 @@
+#pragma once
+#include <opencv2/core.hpp>
+#include <functional>
+#include <future>
+#include <memory>
+#include <vector>
+#include "sls_options.hpp"
+#include "sls_extractor.hpp"
+
+namespace sls {
+
+    // One refinement step: grid spacing opts.gridSpacing * gridStep using
+    // ceil(sigmaFraction * opts.sigma.size()) of the scales.
+    struct ProgressiveLevel {
+        int   gridStep;
+        float sigmaFraction;
+
+        ProgressiveLevel(int step = 1, float fraction = 1.0f)
+            : gridStep(step),
+            sigmaFraction(fraction)
+        {
+        }
+    };
+
+    // Levels run coarse to fine. A final (1, 1.0) level is implied when the
+    // last one is coarser. Grid steps that divide the previous step and
+    // nested scale subsets let later levels reuse earlier SIFT descriptors.
+    struct ProgressiveParams {
+        std::vector<ProgressiveLevel> levels;
+
+        ProgressiveParams()
+        {
+            levels.push_back(ProgressiveLevel(4, 0.25f));
+            levels.push_back(ProgressiveLevel(2, 0.5f));
+            levels.push_back(ProgressiveLevel(1, 1.0f));
+        }
+    };
+
+    struct ProgressiveResult {
+        int        level;        // -1 when nothing was produced
+        bool       final;        // full-resolution result with every scale
+        SLSOutput  output;
+        SLSOptions opts;         // options this level was computed with
+        double     elapsedMs;    // since the extraction started
+
+        ProgressiveResult() : level(-1), final(false), elapsedMs(0.0) {}
+    };
+
+    // Anytime variant of extractScalelessDescs. Runs the levels on a
+    // background thread and reports every level through the callback
+    // (called on that thread) and latest(); finalResult() resolves with the
+    // last completed level once the run finishes or is cancelled, or holds
+    // the exception if extraction or the callback threw. The final level
+    // produces the same descriptors as extractScalelessDescs.
+    class ProgressiveExtractor {
+    public:
+        typedef std::function<void(const ProgressiveResult&)> Callback;
+
+        ProgressiveExtractor(const cv::Mat& I1,
+            const cv::Mat& I2,
+            const SLSOptions& opts,
+            const ProgressiveParams& params = ProgressiveParams(),
+            const Callback& onResult = Callback());
+
+        // Cancels and waits for the worker; do not destroy from the callback.
+        ~ProgressiveExtractor();
+
+        // Stop after the scale currently being computed.
+        void cancel();
+        bool done() const;
+
+        ProgressiveResult latest() const;
+        std::shared_future<ProgressiveResult> finalResult() const;
+
+    private:
+        struct Impl;
+        std::unique_ptr<Impl> impl;
+    };
+}
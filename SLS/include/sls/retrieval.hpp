@@ -0,0 +1,103 @@
+#pragma once
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+#include "sls_options.hpp"
+
+namespace sls {
+
+    struct VocabularyParams {
+        int      branching;         // children per vocabulary tree node
+        int      levels;            // tree depth; up to branching^levels words
+        int      pcaDim;            // descriptor dimension after PCA, 0 keeps all
+        int      maxTrainSamples;   // descriptors sampled for PCA and k-means
+        int      kmeansIterations;
+        unsigned seed;
+
+        VocabularyParams()
+            : branching(10),
+            levels(4),
+            pcaDim(32),
+            maxTrainSamples(200000),
+            kmeansIterations(10),
+            seed(0x5151u)
+        {
+        }
+    };
+
+    struct RetrievalHit {
+        int         image;   // id returned by RetrievalIndex::add
+        std::string name;
+        float       score;   // cosine similarity of the tf-idf vectors, 0..1
+    };
+
+    // D x numPoints scale-averaged dense descriptors of a grayscale image,
+    // the input to RetrievalIndex::train, add and query. References and
+    // queries must use the options the index was trained with.
+    cv::Mat describeImage(const cv::Mat& grayImage, const SLSOptions& opts);
+
+    // Bag-of-visual-words index for one-query-vs-many-references lookups.
+    // Descriptors are reduced with a PCA basis fitted at training time and
+    // quantized by a hierarchical k-means vocabulary tree. References are
+    // kept in an inverted file with tf-idf weights, so a query only touches
+    // the references that share words with it.
+    class RetrievalIndex {
+    public:
+        RetrievalIndex();
+
+        // Fit the PCA basis and the vocabulary tree on descriptors from
+        // describeImage(). Clears any indexed references.
+        bool train(const std::vector<cv::Mat>& descriptors,
+            const SLSOptions& opts,
+            const VocabularyParams& params = VocabularyParams());
+
+        // Add one reference; returns its id. Call finalize() once all
+        // references are in.
+        int add(const cv::Mat& descriptors, const std::string& name);
+
+        // Recompute idf (smoothed, log((N + 1) / (df + 1)) + 1) and the
+        // per-reference normalisation.
+        void finalize();
+
+        // Best `topK` references for the query descriptors, best first.
+        std::vector<RetrievalHit> query(const cv::Mat& descriptors, int topK) const;
+
+        // Visual word of every descriptor column.
+        std::vector<int> quantize(const cv::Mat& descriptors) const;
+
+        bool save(const std::string& path) const;
+        bool load(const std::string& path);
+
+        bool trained() const { return !nodes.empty(); }
+        int numWords() const { return wordCount; }
+        int numImages() const { return static_cast<int>(names.size()); }
+        const SLSOptions& options() const { return opts; }
+
+    private:
+        // Inner tree node. children[c] >= 0 is another node, otherwise the
+        // child is the leaf word -children[c] - 1.
+        struct Node {
+            cv::Mat          centers;   // branching x dim, CV_32F
+            std::vector<int> children;
+        };
+
+        struct Posting {
+            int   image;
+            int   count;
+            float weight;   // tf * idf / |reference vector|, set by finalize
+        };
+
+        int buildNode(const cv::Mat& samples, int depth, const VocabularyParams& params);
+        cv::Mat reduce(const cv::Mat& descriptors) const;
+        void countWords(const cv::Mat& descriptors, std::vector<cv::Vec2i>& wordCounts) const;
+
+        SLSOptions                         opts;
+        cv::PCA                            pca;
+        std::vector<Node>                  nodes;
+        int                                wordCount;
+        std::vector<float>                 idf;
+        std::vector<std::vector<Posting> > postings;   // per word
+        std::vector<std::string>           names;
+        bool                               dirty;
+    };
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "batch.hpp"
+
+namespace sls {
+
+    // Sharded batch runs over a shared-directory work queue. The queue is a
+    // directory with pending/, claimed/, done/ and failed/ subdirectories
+    // holding one file per work unit (a slice of the pair manifest). Workers
+    // claim a unit by renaming it from pending/ to claimed/, which succeeds
+    // for exactly one of them, so any number of worker processes on any
+    // number of machines sharing the directory can pull from it. Workers keep
+    // the lease on their claim alive from a background thread and drop a unit
+    // whose claim was requeued under them.
+    struct ShardParams {
+        int         unitSize;       // pairs per work unit
+        int         leaseSeconds;   // claimed units untouched this long are requeued
+        int         maxAttempts;    // a unit failing this often moves to failed/
+        int         pollMs;         // worker wait when nothing is pending
+        std::string workerId;       // unique per worker; defaultWorkerId() when empty
+
+        ShardParams()
+            : unitSize(16),
+            leaseSeconds(600),
+            maxAttempts(3),
+            pollMs(500)
+        {
+        }
+    };
+
+    struct QueueStatus {
+        int pending;
+        int claimed;
+        int done;
+        int failed;
+    };
+
+    // host-pid, unique enough for workers sharing a queue.
+    std::string defaultWorkerId();
+
+    // Split `pairs` into units under queueDir and store the options text
+    // (may be empty) as queueDir/options.yml for the workers. The lease and
+    // attempt limit go to queueDir/queue.yml and override the values workers
+    // and coordinators pass for this queue. An existing
+    // queue is left untouched so interrupted runs resume; returns the number
+    // of units created, 0 when resuming, -1 on error.
+    int createWorkQueue(const std::string& queueDir,
+        const std::vector<PairEntry>& pairs,
+        const std::string& optionsText,
+        const ShardParams& params);
+
+    QueueStatus queueStatus(const std::string& queueDir);
+
+    // Move claimed units whose lease expired (their worker died or hangs)
+    // back to pending/, counting it as a failed attempt. Returns how many
+    // were moved.
+    int requeueStaleUnits(const std::string& queueDir, const ShardParams& params);
+
+    // Pull and process units until the queue is drained. Every finished
+    // pair leaves a checkpoint (outDir/<name>.done) and is skipped when its
+    // unit is retried or the run is resumed. Units with failed pairs go
+    // back to pending/ until the queue's maxAttempts. Timings are appended to
+    // outDir/timing.<workerId>.jsonl. Returns the number of units this
+    // worker completed.
+    int runShardWorker(const std::string& queueDir,
+        const BatchOptions& opts,
+        const std::string& outDir,
+        const ShardParams& params);
+}
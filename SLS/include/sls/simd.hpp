@@ -0,0 +1,12 @@
+#pragma once
+#include <opencv2/core/version.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+
+// Vector paths use the universal-intrinsic API of OpenCV 4.9 (VTraits,
+// v_add, v_mul, ...). Older OpenCV, or builds without SIMD, take the scalar
+// loops that follow every `#if SLS_SIMD` block.
+#if (CV_VERSION_MAJOR * 100 + CV_VERSION_MINOR >= 409) && (CV_SIMD || CV_SIMD_SCALABLE)
+#define SLS_SIMD 1
+#else
+#define SLS_SIMD 0
+#endif
@@ -1,13 +1,28 @@
 #pragma once
 #include <opencv2/core.hpp>
 #include "sls_options.hpp"
+#include "dense_sift.hpp"
 
 struct SLSOutput {
     cv::Mat desc1;
     cv::Mat desc2;
     cv::Mat pcaBasis;
+    cv::Size grid1;  // s1 x s2 of the image 1 descriptor grid
+    cv::Size grid2;
 };
 
+SLSOptions makeSLSOptions(bool usePaperParams);
+
 SLSOutput extractScalelessDescs(const cv::Mat& I1,
     const cv::Mat& I2,
     bool usePaperParams);
+
+SLSOutput extractScalelessDescs(const cv::Mat& I1,
+    const cv::Mat& I2,
+    const SLSOptions& opts);
+
+// PCA + scale averaging of grids already produced by generateDescriptors
+// with the same options.
+SLSOutput extractScalelessDescs(const DescriptorGrid& dp1,
+    const DescriptorGrid& dp2,
+    const SLSOptions& opts);
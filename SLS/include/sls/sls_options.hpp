@@ -7,12 +7,17 @@ struct SLSOptions {
     int dimReductionCov;
     int subsDim;
     int gridSpacing;
+    // Scales above this sigma are computed on Gaussian-downsampled octaves
+    // (sigma / 2^o <= octaveSigma), so their cost and border do not grow
+    // with the patch area. 0 computes every scale at full resolution.
+    float octaveSigma;
 
     SLSOptions()
         : dimReduction(32),
         dimReductionCov(50000),
         subsDim(10),
-        gridSpacing(1)
+        gridSpacing(1),
+        octaveSigma(0.0f)
     {
     }
 };
@@ -1,4 +1,6 @@
 #include "sls/FlowUtils.hpp"
+#include <opencv2/core/hal/hal.hpp>
+#include "sls/simd.hpp"
 #include <cmath>
 #include <vector>
 #include <algorithm>
@@ -6,6 +8,17 @@
 
 namespace sls {
 
+    cv::Mat gridDescriptorsToImage(const cv::Mat& desc, int s1, int s2)
+    {
+        CV_Assert(desc.type() == CV_32F);
+        CV_Assert(desc.cols == s1 * s2);
+        CV_Assert(desc.rows <= CV_CN_MAX);
+
+        // numPoints x D, continuous, then fold D into channels.
+        cv::Mat descT = desc.t();
+        return descT.reshape(desc.rows, s2).clone();
+    }
+
     cv::Mat computeDenseFlowLocal(
         const cv::Mat& sourceDesc,
         const cv::Mat& targetDesc,
@@ -65,115 +78,298 @@ namespace sls {
         return flow;
     }
 
-    cv::Mat flowToColor(const cv::Mat& flow)
-    {
-        CV_Assert(flow.type() == CV_32FC2);
-        cv::Mat hsv(flow.size(), CV_32FC3);
+    namespace {
+
+        // |flow| at which the colour wheel reaches full brightness.
+        const float kColorMagScale = 0.1f;
 
-        for (int y = 0; y < flow.rows; ++y) {
-            for (int x = 0; x < flow.cols; ++x) {
-                cv::Vec2f v = flow.at<cv::Vec2f>(y, x);
-                float angle = std::atan2(v[1], v[0]);
-                float mag = std::sqrt(v[0] * v[0] + v[1] * v[1]);
+        // One HSV channel for S = 1 without branching on the hue sector:
+        // c = V * (1 - clamp(min(k, 4 - k), 0, 1)), k = (n + H / 60) mod 6.
+        inline float wheelChannel(float h6, float v, float n)
+        {
+            float k = n + h6;
+            if (k >= 6.0f) k -= 6.0f;
+            const float w = std::max(0.0f, std::min(std::min(k, 4.0f - k), 1.0f));
+            return v - v * w;
+        }
 
-                float h = (angle + CV_PI) * (180.0f / CV_PI) / 2.0f;
-                float s = 1.0f;
-                float vval = std::min(mag * 0.1f, 1.0f);
+        // hue in degrees [0, 360), mag in pixels -> BGR bytes.
+        void colorRow(const float* hue, const float* mag, uchar* bgr, int n)
+        {
+            int x = 0;
+#if SLS_SIMD
+            const int VL = cv::VTraits<cv::v_float32>::vlanes();
+            const cv::v_float32 inv60 = cv::vx_setall_f32(1.0f / 60.0f);
+            const cv::v_float32 six = cv::vx_setall_f32(6.0f);
+            const cv::v_float32 four = cv::vx_setall_f32(4.0f);
+            const cv::v_float32 one = cv::vx_setall_f32(1.0f);
+            const cv::v_float32 zero = cv::vx_setzero_f32();
+            const cv::v_float32 vscale = cv::vx_setall_f32(kColorMagScale);
+            const cv::v_float32 v255 = cv::vx_setall_f32(255.0f);
+            const float offsets[3] = { 1.0f, 3.0f, 5.0f };   // B, G, R
+            float lane[3][cv::VTraits<cv::v_float32>::max_nlanes];
 
-                hsv.at<cv::Vec3f>(y, x) = cv::Vec3f(h, s, vval);
+            for (; x <= n - VL; x += VL) {
+                cv::v_float32 h6 = cv::v_mul(cv::vx_load(hue + x), inv60);
+                cv::v_float32 v = cv::v_mul(cv::v_min(cv::v_mul(cv::vx_load(mag + x), vscale), one), v255);
+                for (int c = 0; c < 3; ++c) {
+                    cv::v_float32 k = cv::v_add(h6, cv::vx_setall_f32(offsets[c]));
+                    k = cv::v_select(cv::v_ge(k, six), cv::v_sub(k, six), k);
+                    cv::v_float32 w = cv::v_max(zero, cv::v_min(cv::v_min(k, cv::v_sub(four, k)), one));
+                    cv::v_store(lane[c], cv::v_sub(v, cv::v_mul(v, w)));
+                }
+                for (int l = 0; l < VL; ++l) {
+                    uchar* p = bgr + 3 * (x + l);
+                    p[0] = cv::saturate_cast<uchar>(lane[0][l]);
+                    p[1] = cv::saturate_cast<uchar>(lane[1][l]);
+                    p[2] = cv::saturate_cast<uchar>(lane[2][l]);
+                }
+            }
+#endif
+            for (; x < n; ++x) {
+                const float h6 = hue[x] * (1.0f / 60.0f);
+                const float v = std::min(mag[x] * kColorMagScale, 1.0f) * 255.0f;
+                uchar* p = bgr + 3 * x;
+                p[0] = cv::saturate_cast<uchar>(wheelChannel(h6, v, 1.0f));
+                p[1] = cv::saturate_cast<uchar>(wheelChannel(h6, v, 3.0f));
+                p[2] = cv::saturate_cast<uchar>(wheelChannel(h6, v, 5.0f));
             }
         }
 
-        cv::Mat bgr;
-        cv::cvtColor(hsv, bgr, cv::COLOR_HSV2BGR);
+        // Split n interleaved (u, v) pairs into u and v, scaled by `sign`.
+        void splitFlowRow(const float* f, float* u, float* v, int n, float sign)
+        {
+            int x = 0;
+#if SLS_SIMD
+            const int VL = cv::VTraits<cv::v_float32>::vlanes();
+            const cv::v_float32 s = cv::vx_setall_f32(sign);
+            for (; x <= n - VL; x += VL) {
+                cv::v_float32 a, b;
+                cv::v_load_deinterleave(f + 2 * x, a, b);
+                cv::v_store(u + x, cv::v_mul(a, s));
+                cv::v_store(v + x, cv::v_mul(b, s));
+            }
+#endif
+            for (; x < n; ++x) {
+                u[x] = sign * f[2 * x];
+                v[x] = sign * f[2 * x + 1];
+            }
+        }
+
+        // Per-band partial statistics of evaluateFlowAgainstHomography.
+        struct ErrorStats {
+            double             sum;
+            long long          count;
+            long long          below2;
+            long long          below5;
+            std::vector<float> samples;
+
+            ErrorStats() : sum(0.0), count(0), below2(0), below5(0) {}
+        };
+    }
+
+    cv::Mat flowToColor(const cv::Mat& flow)
+    {
+        CV_Assert(flow.type() == CV_32FC2);
+        cv::Mat bgr(flow.size(), CV_8UC3);
+        const int W = flow.cols;
+
+        cv::parallel_for_(cv::Range(0, flow.rows), [&](const cv::Range& band) {
+            std::vector<float> buf(4 * static_cast<size_t>(W));
+            float* u = &buf[0];
+            float* v = u + W;
+            float* hue = v + W;
+            float* mag = hue + W;
+            for (int y = band.start; y < band.end; ++y) {
+                // The wheel's hue is atan2(v, u) + 180 degrees, i.e. the
+                // direction of (-u, -v).
+                splitFlowRow(flow.ptr<float>(y), u, v, W, -1.0f);
+                cv::hal::fastAtan32f(v, u, hue, W, true);
+                cv::hal::magnitude32f(u, v, mag, W);
+                colorRow(hue, mag, bgr.ptr<uchar>(y), W);
+            }
+        });
         return bgr;
     }
 
     cv::Mat warpImage(const cv::Mat& target, const cv::Mat& flow)
     {
         CV_Assert(target.rows == flow.rows && target.cols == flow.cols);
-        cv::Mat mapX(target.size(), CV_32F);
-        cv::Mat mapY(target.size(), CV_32F);
-
-        for (int y = 0; y < target.rows; ++y) {
-            for (int x = 0; x < target.cols; ++x) {
-                cv::Vec2f v = flow.at<cv::Vec2f>(y, x);
-                mapX.at<float>(y, x) = static_cast<float>(x) + v[0];
-                mapY.at<float>(y, x) = static_cast<float>(y) + v[1];
+        CV_Assert(flow.type() == CV_32FC2);
+
+        // One interleaved (x + u, y + v) map; remap takes it as map1.
+        cv::Mat map(flow.size(), CV_32FC2);
+        const int W = flow.cols;
+        cv::parallel_for_(cv::Range(0, flow.rows), [&](const cv::Range& band) {
+            for (int y = band.start; y < band.end; ++y) {
+                const float* f = flow.ptr<float>(y);
+                float* m = map.ptr<float>(y);
+                const int n = 2 * W;
+                int i = 0;
+#if SLS_SIMD
+                const int VL = cv::VTraits<cv::v_float32>::vlanes();
+                // Lanes alternate x and y; x advances VL / 2 per step.
+                float base[cv::VTraits<cv::v_float32>::max_nlanes];
+                float inc[cv::VTraits<cv::v_float32>::max_nlanes];
+                for (int l = 0; l < VL; ++l) {
+                    base[l] = (l % 2 == 0) ? static_cast<float>(l / 2) : static_cast<float>(y);
+                    inc[l] = (l % 2 == 0) ? static_cast<float>(VL / 2) : 0.0f;
+                }
+                cv::v_float32 pos = cv::vx_load(base);
+                const cv::v_float32 step = cv::vx_load(inc);
+                for (; i <= n - VL; i += VL) {
+                    cv::v_store(m + i, cv::v_add(cv::vx_load(f + i), pos));
+                    pos = cv::v_add(pos, step);
+                }
+#endif
+                for (; i < n; i += 2) {
+                    m[i] = static_cast<float>(i / 2) + f[i];
+                    m[i + 1] = static_cast<float>(y) + f[i + 1];
+                }
             }
-        }
+        });
 
         cv::Mat warped;
-        cv::remap(target, warped, mapX, mapY, cv::INTER_LINEAR);
+        cv::remap(target, warped, map, cv::noArray(), cv::INTER_LINEAR);
         return warped;
     }
 
     FlowEvalResult evaluateFlowAgainstHomography(
         const cv::Mat& flow,
         const cv::Mat& H,
-        int step)
+        int step,
+        std::vector<float>* errors,
+        const cv::Mat& valid)
     {
         CV_Assert(flow.type() == CV_32FC2);
         CV_Assert(H.rows == 3 && H.cols == 3);
         CV_Assert(H.type() == CV_64F);
+        CV_Assert(step >= 1);
+        CV_Assert(valid.empty() || (valid.type() == CV_8UC1 && valid.size() == flow.size()));
 
-        int Himg = flow.rows;
-        int Wimg = flow.cols;
+        const int sampleRows = (flow.rows + step - 1) / step;
+        const int sampleCols = (flow.cols + step - 1) / step;
 
         cv::Matx33d Hm;
         H.copyTo(Hm);
 
-        std::vector<double> errors;
-        errors.reserve((Himg / step) * (Wimg / step));
-
-        for (int y = 0; y < Himg; y += step) {
-            for (int x = 0; x < Wimg; x += step) {
-                cv::Vec2f v = flow.at<cv::Vec2f>(y, x);
-                double xPred = static_cast<double>(x) + v[0];
-                double yPred = static_cast<double>(y) + v[1];
-
-                cv::Vec3d p(static_cast<double>(x),
-                    static_cast<double>(y),
-                    1.0);
-                cv::Vec3d q = Hm * p;
-                double u = q[0] / q[2];
-                double vgt = q[1] / q[2];
-
-                double dx = xPred - u;
-                double dy = yPred - vgt;
-                double err = std::sqrt(dx * dx + dy * dy);
-                errors.push_back(err);
+        // Each band keeps private counters and its own error samples; they
+        // are joined once for the median.
+        const int numBands = std::max(1, std::min(sampleRows, 4 * cv::getNumThreads()));
+        std::vector<ErrorStats> bands(numBands);
+
+        cv::parallel_for_(cv::Range(0, numBands), [&](const cv::Range& r) {
+            std::vector<float> buf(3 * static_cast<size_t>(sampleCols));
+            float* u = &buf[0];
+            float* v = u + sampleCols;
+            float* err = v + sampleCols;
+
+            for (int b = r.start; b < r.end; ++b) {
+                ErrorStats& st = bands[b];
+                const int i0 = static_cast<int>(static_cast<long long>(sampleRows) * b / numBands);
+                const int i1 = static_cast<int>(static_cast<long long>(sampleRows) * (b + 1) / numBands);
+
+                for (int i = i0; i < i1; ++i) {
+                    const int y = i * step;
+                    const float* f = flow.ptr<float>(y);
+                    if (step == 1) {
+                        splitFlowRow(f, u, v, sampleCols, 1.0f);
+                    }
+                    else {
+                        for (int k = 0; k < sampleCols; ++k) {
+                            u[k] = f[2 * k * step];
+                            v[k] = f[2 * k * step + 1];
+                        }
+                    }
+
+                    // H * (x, y, 1) is affine in x along a row.
+                    const float a0 = static_cast<float>(Hm(0, 0) * step);
+                    const float a1 = static_cast<float>(Hm(1, 0) * step);
+                    const float a2 = static_cast<float>(Hm(2, 0) * step);
+                    const float c0 = static_cast<float>(Hm(0, 1) * y + Hm(0, 2));
+                    const float c1 = static_cast<float>(Hm(1, 1) * y + Hm(1, 2));
+                    const float c2 = static_cast<float>(Hm(2, 1) * y + Hm(2, 2));
+                    const float fs = static_cast<float>(step);
+                    const float fy = static_cast<float>(y);
+
+                    int k = 0;
+#if SLS_SIMD
+                    const int VL = cv::VTraits<cv::v_float32>::vlanes();
+                    float idx[cv::VTraits<cv::v_float32>::max_nlanes];
+                    for (int l = 0; l < VL; ++l) idx[l] = static_cast<float>(l);
+                    cv::v_float32 kv = cv::vx_load(idx);
+                    const cv::v_float32 kstep = cv::vx_setall_f32(static_cast<float>(VL));
+                    const cv::v_float32 va0 = cv::vx_setall_f32(a0), va1 = cv::vx_setall_f32(a1),
+                        va2 = cv::vx_setall_f32(a2), vc0 = cv::vx_setall_f32(c0),
+                        vc1 = cv::vx_setall_f32(c1), vc2 = cv::vx_setall_f32(c2);
+                    const cv::v_float32 vfs = cv::vx_setall_f32(fs), vfy = cv::vx_setall_f32(fy);
+                    const cv::v_float32 one = cv::vx_setall_f32(1.0f);
+                    for (; k <= sampleCols - VL; k += VL) {
+                        cv::v_float32 iw = cv::v_div(one, cv::v_fma(va2, kv, vc2));
+                        cv::v_float32 gx = cv::v_mul(cv::v_fma(va0, kv, vc0), iw);
+                        cv::v_float32 gy = cv::v_mul(cv::v_fma(va1, kv, vc1), iw);
+                        cv::v_float32 dx = cv::v_sub(cv::v_fma(kv, vfs, cv::vx_load(u + k)), gx);
+                        cv::v_float32 dy = cv::v_sub(cv::v_add(vfy, cv::vx_load(v + k)), gy);
+                        cv::v_store(err + k, cv::v_sqrt(cv::v_fma(dx, dx, cv::v_mul(dy, dy))));
+                        kv = cv::v_add(kv, kstep);
+                    }
+#endif
+                    for (; k < sampleCols; ++k) {
+                        const float fk = static_cast<float>(k);
+                        const float iw = 1.0f / (a2 * fk + c2);
+                        const float dx = fk * fs + u[k] - (a0 * fk + c0) * iw;
+                        const float dy = fy + v[k] - (a1 * fk + c1) * iw;
+                        err[k] = std::sqrt(dx * dx + dy * dy);
+                    }
+
+                    const uchar* mask = valid.empty() ? nullptr : valid.ptr<uchar>(y);
+                    for (int j = 0; j < sampleCols; ++j) {
+                        if (mask && !mask[j * step]) continue;
+                        const float e = err[j];
+                        st.sum += e;
+                        if (e <= 2.0f) ++st.below2;
+                        if (e <= 5.0f) ++st.below5;
+                        st.samples.push_back(e);
+                    }
+                    st.count = static_cast<long long>(st.samples.size());
+                }
             }
+        });
+
+        ErrorStats total;
+        total.samples.reserve(static_cast<size_t>(sampleRows) * sampleCols);
+        for (ErrorStats& st : bands) {
+            total.sum += st.sum;
+            total.count += st.count;
+            total.below2 += st.below2;
+            total.below5 += st.below5;
+            total.samples.insert(total.samples.end(), st.samples.begin(), st.samples.end());
+            std::vector<float>().swap(st.samples);
         }
+        if (errors) errors->insert(errors->end(), total.samples.begin(), total.samples.end());
 
         FlowEvalResult res{};
-        res.numSamples = static_cast<int>(errors.size());
-        if (errors.empty()) {
+        res.numSamples = static_cast<int>(total.count);
+        res.validFraction = static_cast<double>(total.count) / (static_cast<double>(sampleRows) * sampleCols);
+        if (total.count == 0) {
             res.meanError = res.medianError = 0.0;
             res.percentBelow2px = res.percentBelow5px = 0.0;
             return res;
         }
 
-        double sum = 0.0;
-        for (double e : errors) sum += e;
-        res.meanError = sum / errors.size();
+        res.meanError = total.sum / total.count;
 
-        std::sort(errors.begin(), errors.end());
-        if (errors.size() % 2 == 1) {
-            res.medianError = errors[errors.size() / 2];
-        }
-        else {
-            res.medianError = 0.5 * (errors[errors.size() / 2 - 1] +
-                errors[errors.size() / 2]);
+        std::vector<float>& e = total.samples;
+        const size_t mid = e.size() / 2;
+        std::nth_element(e.begin(), e.begin() + mid, e.end());
+        res.medianError = e[mid];
+        if (e.size() % 2 == 0) {
+            // The lower middle is the largest of the first half.
+            res.medianError = 0.5 * (*std::max_element(e.begin(), e.begin() + mid) + res.medianError);
         }
 
-        int count2 = 0, count5 = 0;
-        for (double e : errors) {
-            if (e <= 2.0) ++count2;
-            if (e <= 5.0) ++count5;
-        }
-        res.percentBelow2px = 100.0 * (double)count2 / errors.size();
-        res.percentBelow5px = 100.0 * (double)count5 / errors.size();
+        res.percentBelow2px = 100.0 * (double)total.below2 / total.count;
+        res.percentBelow5px = 100.0 * (double)total.below5 / total.count;
 
         return res;
     }
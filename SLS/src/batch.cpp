@@ -0,0 +1,403 @@
+#include "sls/batch.hpp"
+#include "sls/dense_sift.hpp"
+#include "sls/sls_extractor.hpp"
+#include "sls/FlowUtils.hpp"
+#include "sls/flow_upsample.hpp"
+#include "sls/ingest.hpp"
+#include "sls/matcher.hpp"
+#include "sls/memory_plan.hpp"
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/core/utils/filesystem.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace sls {
+
+    namespace {
+
+        std::string joinPath(const std::string& dir, const std::string& file)
+        {
+            if (dir.empty()) return file;
+            char last = dir[dir.size() - 1];
+            if (last == '/' || last == '\\') return dir + file;
+            return dir + "/" + file;
+        }
+
+        std::string jsonEscape(const std::string& s)
+        {
+            std::string out;
+            out.reserve(s.size());
+            for (char c : s) {
+                switch (c) {
+                case '"':  out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                case '\b': out += "\\b"; break;
+                case '\f': out += "\\f"; break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        char buf[8];
+                        std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned char>(c));
+                        out += buf;
+                    }
+                    else {
+                        out += c;
+                    }
+                }
+            }
+            return out;
+        }
+
+        // Read a scalar only when the key is present.
+        template <typename T>
+        void readIfPresent(const cv::FileNode& node, const char* key, T& value)
+        {
+            cv::FileNode n = node[key];
+            if (!n.empty()) n >> value;
+        }
+
+        void readFlag(const cv::FileNode& node, const char* key, bool& value)
+        {
+            cv::FileNode n = node[key];
+            if (!n.empty()) value = static_cast<int>(n) != 0;
+        }
+    }
+
+    BatchOptions::BatchOptions()
+        : sls(makeSLSOptions(false)),
+        useSLS(true),
+        scaleFactor(0.25),
+        crossCheck(true),
+        ratio(0.0f),
+        maxMatches(0),
+        memoryBudgetMB(0),
+        writeDescriptors(true),
+        writeFlow(true),
+        writeFlowColor(false),
+        writeMatches(true)
+    {
+    }
+
+    // Shared by the file and in-memory loaders; `what` names the source in
+    // error messages.
+    static bool readBatchOptions(const std::string& source, int flags,
+        const std::string& what, BatchOptions& opts)
+    {
+        try {
+            cv::FileStorage fs(source, flags);
+            if (!fs.isOpened()) {
+                std::cerr << "loadBatchOptions: could not open " << what << "\n";
+                return false;
+            }
+            cv::FileNode root = fs.root();
+
+            std::string mode;
+            readIfPresent(root, "mode", mode);
+            if (mode == "dsift") opts.useSLS = false;
+            else if (mode == "sls") opts.useSLS = true;
+            else if (!mode.empty()) {
+                std::cerr << "loadBatchOptions: unknown mode '" << mode << "'\n";
+                return false;
+            }
+            readIfPresent(root, "scaleFactor", opts.scaleFactor);
+            readFlag(root, "crossCheck", opts.crossCheck);
+            readIfPresent(root, "ratio", opts.ratio);
+            readIfPresent(root, "memoryBudgetMB", opts.memoryBudgetMB);
+
+            cv::FileNode sn = root["sls"];
+            if (!sn.empty()) {
+                std::string preset;
+                readIfPresent(sn, "preset", preset);
+                if (preset == "paper") opts.sls = makeSLSOptions(true);
+                else if (preset == "light") opts.sls = makeSLSOptions(false);
+
+                readIfPresent(sn, "sigma", opts.sls.sigma);
+                readIfPresent(sn, "gridSpacing", opts.sls.gridSpacing);
+                readIfPresent(sn, "dimReduction", opts.sls.dimReduction);
+                readIfPresent(sn, "dimReductionCov", opts.sls.dimReductionCov);
+                readIfPresent(sn, "subsDim", opts.sls.subsDim);
+                readIfPresent(sn, "octaveSigma", opts.sls.octaveSigma);
+            }
+
+            cv::FileNode fn = root["flow"];
+            if (!fn.empty()) {
+                readFlag(fn, "enabled", opts.flow.enabled);
+                readFlag(fn, "regularize", opts.flow.regularize);
+                readIfPresent(fn, "windowRadius", opts.flow.windowRadius);
+                readIfPresent(fn, "P1", opts.flow.sgm.P1);
+                readIfPresent(fn, "P2", opts.flow.sgm.P2);
+                readIfPresent(fn, "numPaths", opts.flow.sgm.numPaths);
+                readIfPresent(fn, "maxVolumeMB", opts.flow.sgm.maxVolumeMB);
+                readFlag(fn, "upsample", opts.flow.upsample);
+                readIfPresent(fn, "sigmaRange", opts.flow.sigmaRange);
+            }
+
+            cv::FileNode on = root["outputs"];
+            if (!on.empty()) {
+                readFlag(on, "descriptors", opts.writeDescriptors);
+                readFlag(on, "flow", opts.writeFlow);
+                readFlag(on, "flowColor", opts.writeFlowColor);
+                readFlag(on, "matches", opts.writeMatches);
+                readIfPresent(on, "maxMatches", opts.maxMatches);
+            }
+        }
+        catch (const cv::Exception& e) {
+            std::cerr << "loadBatchOptions: failed to parse " << what << ": " << e.what() << "\n";
+            return false;
+        }
+
+        if (opts.sls.sigma.empty() || opts.sls.gridSpacing < 1 || opts.scaleFactor <= 0.0) {
+            std::cerr << "loadBatchOptions: invalid sigma list, gridSpacing or scaleFactor in "
+                << what << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    bool loadBatchOptions(const std::string& path, BatchOptions& opts)
+    {
+        return readBatchOptions(path, cv::FileStorage::READ, path, opts);
+    }
+
+    bool parseBatchOptions(const std::string& text, BatchOptions& opts)
+    {
+        if (text.empty()) return true;
+        return readBatchOptions(text, cv::FileStorage::READ | cv::FileStorage::MEMORY,
+            "<options string>", opts);
+    }
+
+    bool loadPairManifest(const std::string& path, std::vector<PairEntry>& pairs)
+    {
+        std::ifstream in(path);
+        if (!in) {
+            std::cerr << "loadPairManifest: could not open " << path << "\n";
+            return false;
+        }
+
+        std::string line;
+        int lineNo = 0;
+        while (std::getline(in, line)) {
+            ++lineNo;
+            std::istringstream ss(line);
+            PairEntry e;
+            if (!(ss >> e.source) || e.source[0] == '#') continue;
+            if (!(ss >> e.target)) {
+                std::cerr << "loadPairManifest: " << path << ":" << lineNo
+                    << ": expected 'source target [name]'\n";
+                return false;
+            }
+            if (!(ss >> e.name)) {
+                e.name = "pair_" + std::to_string(pairs.size());
+            }
+            pairs.push_back(e);
+        }
+        return true;
+    }
+
+    cv::Mat computePairFlow(const cv::Mat& desc1,
+        const cv::Mat& desc2,
+        const cv::Size& grid1,
+        const cv::Size& grid2,
+        const cv::Mat& guide,
+        const BatchOptions& opts)
+    {
+        if (grid1 != grid2) return cv::Mat();
+
+        cv::Mat d1 = gridDescriptorsToImage(desc1, grid1.width, grid1.height);
+        cv::Mat d2 = gridDescriptorsToImage(desc2, grid2.width, grid2.height);
+
+        cv::Mat flow;
+        if (opts.flow.regularize) {
+            SGMParams sgm = opts.flow.sgm;
+            sgm.windowRadius = opts.flow.windowRadius;
+            flow = computeDenseFlowSGM(d1, d2, sgm);
+        }
+        else {
+            flow = computeDenseFlowLocal(d1, d2, opts.flow.windowRadius);
+        }
+
+        if (!flow.empty() && opts.flow.upsample) {
+            FlowUpsampleParams up;
+            up.gridSpacing = opts.sls.gridSpacing;
+            up.sigmaRange = opts.flow.sigmaRange;
+            flow = upsampleFlow(flow, guide, up);
+        }
+        return flow;
+    }
+
+    PairResult processPair(const PairEntry& pair,
+        const BatchOptions& opts,
+        const std::string& outDir)
+    {
+        PairResult res{};
+        res.ok = false;
+
+        cv::TickMeter total, tm;
+        total.start();
+
+        // --- Load ---
+        tm.start();
+        cv::Mat I1 = loadGrayscale(pair.source, opts.scaleFactor);
+        cv::Mat I2 = loadGrayscale(pair.target, opts.scaleFactor);
+        if (I1.empty() || I2.empty()) {
+            res.error = "could not load " + (I1.empty() ? pair.source : pair.target);
+            return res;
+        }
+        tm.stop();
+        res.timing.loadMs = tm.getTimeMilli();
+
+        // --- Extract ---
+        tm.reset();
+        tm.start();
+        cv::Mat desc1, desc2, pcaBasis;
+        cv::Size grid1, grid2;
+        if (opts.memoryBudgetMB > 0) {
+            // Without PCA the banded path reduces to DSIFT scale averaging.
+            SLSOptions sls = opts.sls;
+            if (!opts.useSLS) sls.dimReduction = 0;
+            MemoryPlanParams mp;
+            mp.budgetBytes = static_cast<size_t>(opts.memoryBudgetMB) * 1024 * 1024;
+            SLSOutput o = extractScalelessDescsWithinBudget(I1, I2, sls, mp);
+            desc1 = o.desc1;
+            desc2 = o.desc2;
+            if (opts.useSLS) pcaBasis = o.pcaBasis;
+            grid1 = o.grid1;
+            grid2 = o.grid2;
+        }
+        else if (opts.useSLS) {
+            SLSOutput o = extractScalelessDescs(I1, I2, opts.sls);
+            desc1 = o.desc1;
+            desc2 = o.desc2;
+            pcaBasis = o.pcaBasis;
+            grid1 = o.grid1;
+            grid2 = o.grid2;
+        }
+        else {
+            const int numSigma = static_cast<int>(opts.sls.sigma.size());
+            DescriptorGrid g1 = generateDescriptors(I1, opts.sls);
+            DescriptorGrid g2 = generateDescriptors(I2, opts.sls);
+            desc1 = averageAcrossScales(g1.dpMat, g1.numPoints, numSigma);
+            desc2 = averageAcrossScales(g2.dpMat, g2.numPoints, numSigma);
+            grid1 = cv::Size(g1.s1, g1.s2);
+            grid2 = cv::Size(g2.s1, g2.s2);
+        }
+        tm.stop();
+        res.timing.extractMs = tm.getTimeMilli();
+
+        if (desc1.empty() || desc2.empty()) {
+            res.error = "descriptor extraction produced no points";
+            return res;
+        }
+        res.numPoints1 = desc1.cols;
+        res.numPoints2 = desc2.cols;
+
+        // --- Flow ---
+        tm.reset();
+        tm.start();
+        cv::Mat flow;
+        if (opts.flow.enabled && grid1 != grid2) {
+            std::cerr << "processPair: " << pair.name
+                << ": descriptor grids differ in size, skipping flow.\n";
+        }
+        else if (opts.flow.enabled) {
+            flow = computePairFlow(desc1, desc2, grid1, grid2, I1, opts);
+            if (flow.empty()) {
+                // A refused SGM volume has already been reported with its size.
+                std::cerr << "processPair: " << pair.name << (opts.flow.regularize
+                    ? ": regularized flow refused (cost volume over sgm.maxVolumeMB), skipping flow.\n"
+                    : ": flow computation failed, skipping flow.\n");
+            }
+        }
+        tm.stop();
+        res.timing.flowMs = tm.getTimeMilli();
+
+        // --- Match ---
+        tm.reset();
+        tm.start();
+        MatcherParams mp;
+        mp.mutual = opts.crossCheck;
+        mp.ratio = opts.ratio;
+        std::vector<cv::DMatch> matches = matchDescriptors(desc1, desc2, mp);
+        std::sort(matches.begin(), matches.end(),
+            [](const cv::DMatch& a, const cv::DMatch& b) {
+                return a.distance < b.distance;
+            });
+        if (opts.maxMatches > 0 && matches.size() > static_cast<size_t>(opts.maxMatches)) {
+            matches.resize(opts.maxMatches);
+        }
+        tm.stop();
+        res.timing.matchMs = tm.getTimeMilli();
+        res.numMatches = static_cast<int>(matches.size());
+
+        // --- Write ---
+        tm.reset();
+        tm.start();
+        if (!outDir.empty()) {
+            cv::utils::fs::createDirectories(outDir);
+        }
+
+        if (opts.writeDescriptors) {
+            cv::FileStorage fs(joinPath(outDir, pair.name + ".desc.yml.gz"), cv::FileStorage::WRITE);
+            fs << "desc1" << desc1 << "desc2" << desc2;
+            fs << "grid1" << grid1 << "grid2" << grid2;
+            if (!pcaBasis.empty()) fs << "pcaBasis" << pcaBasis;
+        }
+
+        if (!flow.empty() && opts.writeFlow) {
+            cv::writeOpticalFlow(joinPath(outDir, pair.name + ".flo"), flow);
+        }
+        if (!flow.empty() && opts.writeFlowColor) {
+            cv::Mat color = flowToColor(flow);
+            cv::imwrite(joinPath(outDir, pair.name + "_flow.png"), color);
+        }
+
+        if (opts.writeMatches) {
+            // Grid node (i, j) sits on pixel (j, i) * gridSpacing of the scaled
+            // image; report coordinates in the original image.
+            const double toOrig = static_cast<double>(opts.sls.gridSpacing) / opts.scaleFactor;
+            std::ofstream csv(joinPath(outDir, pair.name + ".matches.csv"));
+            csv << "query,train,distance,x1,y1,x2,y2\n";
+            for (const cv::DMatch& m : matches) {
+                csv << m.queryIdx << ',' << m.trainIdx << ',' << m.distance << ','
+                    << (m.queryIdx % grid1.width) * toOrig << ','
+                    << (m.queryIdx / grid1.width) * toOrig << ','
+                    << (m.trainIdx % grid2.width) * toOrig << ','
+                    << (m.trainIdx / grid2.width) * toOrig << '\n';
+            }
+        }
+        tm.stop();
+        res.timing.writeMs = tm.getTimeMilli();
+
+        total.stop();
+        res.timing.totalMs = total.getTimeMilli();
+        res.ok = true;
+        return res;
+    }
+
+    void writeTimingJson(std::ostream& os, const PairEntry& pair, const PairResult& res)
+    {
+        os << "{\"name\":\"" << jsonEscape(pair.name) << "\""
+            << ",\"source\":\"" << jsonEscape(pair.source) << "\""
+            << ",\"target\":\"" << jsonEscape(pair.target) << "\""
+            << ",\"ok\":" << (res.ok ? "true" : "false");
+        if (!res.ok) {
+            os << ",\"error\":\"" << jsonEscape(res.error) << "\"";
+        }
+        os << ",\"points1\":" << res.numPoints1
+            << ",\"points2\":" << res.numPoints2
+            << ",\"matches\":" << res.numMatches
+            << ",\"load_ms\":" << res.timing.loadMs
+            << ",\"extract_ms\":" << res.timing.extractMs
+            << ",\"flow_ms\":" << res.timing.flowMs
+            << ",\"match_ms\":" << res.timing.matchMs
+            << ",\"write_ms\":" << res.timing.writeMs
+            << ",\"total_ms\":" << res.timing.totalMs
+            << "}\n";
+    }
+}
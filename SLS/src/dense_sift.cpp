@@ -1,50 +1,323 @@
 #include "sls/dense_sift.hpp"
 #include "sls/sls_options.hpp"
+#include "sls/descriptor_cache.hpp"
 
 #include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <climits>
 #include <cmath>
 #include <iostream>
 
 using namespace cv;
 
+// Half the patch of one scale: the border that keeps it inside the image.
+static int patchPadSize(float sigma) {
+    // Padding size similar to MATLAB code
+    const float NBP = 4.0f;
+    const float SBP = 3.0f * sigma;
+    const float w = SBP * (NBP + 1.0f);
+    return static_cast<int>(std::ceil(w / 2.0f));
+}
+
+// Sampling radius of cv::SIFT's descriptor (calcSIFTDescriptor with d = 4
+// and scl = size / 2), one pixel each for centre rounding and the gradient,
+// and the radius of the Gaussian that turns the input into SIFT's base
+// level (sigma over an assumed 0.5 camera blur, 4-sigma float kernel).
+int descriptorReach(float sigma, double siftSigma) {
+    const float NBP = 4.0f;
+    const float patchSize = 3.0f * sigma * (NBP + 1.0f);
+    const float histWidth = 3.0f * 0.5f * patchSize;
+    const int radius = cvRound(histWidth * 1.4142135623730951f * (NBP + 1.0f) * 0.5f);
+    const double sigDiff = std::sqrt(std::max(siftSigma * siftSigma - 0.25, 0.01));
+    return radius + 2 + cvCeil(4.0 * sigDiff);
+}
+
+// Border needed so the largest full-resolution patch stays inside the
+// padded image.
+int descriptorPadSize(const SLSOptions& opts) {
+    if (opts.octaveSigma <= 0.0f) {
+        return patchPadSize(opts.sigma.back());
+    }
+    int pad = 0;
+    for (float s : opts.sigma) {
+        if (descriptorOctave(s, opts) == 0) pad = std::max(pad, patchPadSize(s));
+    }
+    return pad;
+}
+
+// Smallest o with sigma / 2^o <= opts.octaveSigma.
+int descriptorOctave(float sigma, const SLSOptions& opts) {
+    if (opts.octaveSigma <= 0.0f || sigma <= opts.octaveSigma) {
+        return 0;
+    }
+    return static_cast<int>(std::ceil(std::log2(sigma / opts.octaveSigma)));
+}
+
+int octavePadSize(int octave, const SLSOptions& opts) {
+    const float f = static_cast<float>(1 << octave);
+    int pad = 0;
+    for (float s : opts.sigma) {
+        if (descriptorOctave(s, opts) == octave) pad = std::max(pad, patchPadSize(s / f));
+    }
+    return pad;
+}
+
+// Convert to 8-bit once (float input is taken as [0,1]) and pad once.
+PaddedImage padForDescriptors(const Mat& grayImage, const SLSOptions& opts) {
+    PaddedImage out;
+    out.padSize = 0;
+
+    if (grayImage.empty()) {
+        return out;
+    }
+
+    Mat gray8;
+    if (grayImage.channels() > 1) {
+        cvtColor(grayImage, gray8, COLOR_BGR2GRAY);
+    }
+    else {
+        gray8 = grayImage;
+    }
+    if (gray8.depth() != CV_8U) {
+        gray8.convertTo(gray8, CV_8U, 255.0);
+    }
+
+    out.padSize = descriptorPadSize(opts);
+    copyMakeBorder(gray8, out.padded,
+        out.padSize, out.padSize, out.padSize, out.padSize,
+        BORDER_REFLECT_101);
+
+    // Octave mode: pyrDown blurs before it decimates, and each level gets
+    // only the border its own (scaled) patches need.
+    int numOctaves = 0;
+    for (float s : opts.sigma) {
+        numOctaves = std::max(numOctaves, descriptorOctave(s, opts));
+    }
+    Mat level = gray8;
+    for (int o = 1; o <= numOctaves; ++o) {
+        Mat next;
+        pyrDown(level, next);
+        level = next;
+
+        const int pad = octavePadSize(o, opts);
+        Mat padded;
+        copyMakeBorder(level, padded, pad, pad, pad, pad, BORDER_REFLECT_101);
+        out.octaves.push_back(padded);
+        out.octavePads.push_back(pad);
+    }
+    return out;
+}
+
 // Generate dense SIFT descriptors on a regular grid.
 DescriptorGrid generateDescriptors(const Mat& grayImage, const SLSOptions& opts) {
-    DescriptorGrid out;
+    return generateDescriptors(grayImage, opts, SIFT::create());
+}
 
+DescriptorGrid generateDescriptors(const Mat& grayImage,
+    const SLSOptions& opts,
+    const Ptr<SIFT>& sift) {
     if (grayImage.empty()) {
         std::cerr << "generateDescriptors: input image is empty\n";
-        return out;
+        return DescriptorGrid();
     }
 
-    // Padding size similar to MATLAB code
+    // Same pixels and options give the same grid; reuse it when cached.
+    std::shared_ptr<sls::DescriptorCache> cache = sls::descriptorCache();
+    if (!cache) {
+        return generateDescriptors(padForDescriptors(grayImage, opts), opts, sift);
+    }
+
+    const std::string key = sls::DescriptorCache::gridKey(sls::DescriptorCache::imageKey(grayImage), opts, sift);
+    DescriptorGrid grid;
+    if (cache->loadGrid(key, grid)) {
+        return grid;
+    }
+    grid = generateDescriptors(padForDescriptors(grayImage, opts), opts, sift);
+    cache->storeGrid(key, grid);
+    return grid;
+}
+
+DescriptorGrid generateDescriptors(const PaddedImage& image,
+    const SLSOptions& opts,
+    const Ptr<SIFT>& sift) {
+    return generateDescriptorRows(image, opts, sift, 0, INT_MAX);
+}
+
+// SIFT descriptors (points x 128) of one scale at the given points of an
+// 8-bit padded image.
+Mat siftAtPoints(const Mat& padded,
+    const std::vector<Point2f>& points,
+    float sigma,
+    const Ptr<SIFT>& sift) {
     const float NBP = 4.0f;
-    const float SBP = 3.0f * opts.sigma.back();
-    const float w = SBP * (NBP + 1.0f);
-    const int   padSize = static_cast<int>(std::ceil(w / 2.0f));
+    const int D = 128;
+    const int numPoints = static_cast<int>(points.size());
+    const float patchSize = 3.0f * sigma * (NBP + 1.0f);
 
-    Mat paddedFloat;
-    copyMakeBorder(grayImage, paddedFloat,
-        padSize, padSize, padSize, padSize,
-        BORDER_REFLECT_101);
+    if (numPoints == 0) {
+        return Mat(0, D, CV_32F);
+    }
+
+    std::vector<KeyPoint> keypoints;
+    keypoints.reserve(numPoints);
 
-    Mat padded;
-    if (paddedFloat.depth() != CV_8U) {
-        paddedFloat.convertTo(padded, CV_8U, 255.0);
+    for (int i = 0; i < numPoints; ++i) {
+        KeyPoint kp;
+        kp.pt = points[i];
+        kp.size = patchSize;
+        kp.angle = 0.0f;
+        keypoints.push_back(kp);
     }
-    else {
-        padded = paddedFloat;
+
+    Mat desc;
+    sift->compute(padded, keypoints, desc);
+
+    if (desc.rows != numPoints || desc.cols != D) {
+        std::cerr << "generateDescriptors: unexpected SIFT size ("
+            << desc.rows << "x" << desc.cols << "), expected "
+            << numPoints << "x" << D << "\n";
+    }
+    return desc;
+}
+
+// Descriptors of one scale at points of the full-resolution padded image.
+// Level 0 points sit on pixels. On an octave, point (x, y) maps to
+// ((x, y) - padSize) / 2^o + octavePad, generally between pixels; SIFT
+// rounds keypoint centres, so descriptors are computed on the surrounding
+// octave pixels (each shared by many points) and blended bilinearly.
+Mat siftAtScale(const PaddedImage& image,
+    const std::vector<Point2f>& points,
+    float sigma,
+    const SLSOptions& opts,
+    const Ptr<SIFT>& sift) {
+    const int D = 128;
+    const int numPoints = static_cast<int>(points.size());
+    if (numPoints == 0) {
+        return Mat(0, D, CV_32F);
+    }
+
+    const int octave = descriptorOctave(sigma, opts);
+    CV_Assert(octave <= static_cast<int>(image.octaves.size()));
+    const Mat& src = octave == 0 ? image.padded : image.octaves[octave - 1];
+    const int pad = octave == 0 ? image.padSize : image.octavePads[octave - 1];
+    const float scale = 1.0f / static_cast<float>(1 << octave);
+
+    std::vector<Point2f> pts(numPoints);
+    float yMin = FLT_MAX, yMax = -FLT_MAX;
+    for (int i = 0; i < numPoints; ++i) {
+        pts[i].x = (points[i].x - image.padSize) * scale + pad;
+        pts[i].y = (points[i].y - image.padSize) * scale + pad;
+        yMin = std::min(yMin, pts[i].y);
+        yMax = std::max(yMax, pts[i].y);
+    }
+
+    // Only the rows SIFT reads for these points, so any band of the grid
+    // gets the descriptors the whole image would give.
+    const int margin = descriptorReach(sigma * scale, sift->getSigma());
+    const int yTop = std::max(0, static_cast<int>(std::floor(yMin)) - margin);
+    const int yBottom = std::min(src.rows, static_cast<int>(std::ceil(yMax)) + margin + 1);
+    const Mat band = src.rowRange(yTop, yBottom);
+
+    if (octave == 0) {
+        for (Point2f& p : pts) p.y -= yTop;
+        return siftAtPoints(band, pts, sigma, sift);
     }
 
-    const int rows = padded.rows;
-    const int cols = padded.cols;
+    int x0 = INT_MAX, x1 = INT_MIN;
+    for (const Point2f& p : pts) {
+        x0 = std::min(x0, static_cast<int>(std::floor(p.x)));
+        x1 = std::max(x1, static_cast<int>(std::floor(p.x)) + 1);
+    }
+    const int y0 = static_cast<int>(std::floor(yMin));
+    const int y1 = static_cast<int>(std::floor(yMax)) + 1;
+
+    // Octave pixels the points need, each computed once.
+    Mat_<int> node(y1 - y0 + 1, x1 - x0 + 1, -1);
+    std::vector<Point2f> lattice;
+    std::vector<int> corner(4 * numPoints);
+    std::vector<float> weight(4 * numPoints);
+    for (int i = 0; i < numPoints; ++i) {
+        const int fx = static_cast<int>(std::floor(pts[i].x));
+        const int fy = static_cast<int>(std::floor(pts[i].y));
+        const float ax = pts[i].x - fx;
+        const float ay = pts[i].y - fy;
+        const float w[4] = { (1 - ax) * (1 - ay), ax * (1 - ay), (1 - ax) * ay, ax * ay };
+        for (int k = 0; k < 4; ++k) {
+            const int x = fx + (k & 1);
+            const int y = fy + (k >> 1);
+            weight[4 * i + k] = w[k];
+            corner[4 * i + k] = -1;
+            if (w[k] <= 0.0f) continue;
+            int& n = node(y - y0, x - x0);
+            if (n < 0) {
+                n = static_cast<int>(lattice.size());
+                lattice.push_back(Point2f(static_cast<float>(x), static_cast<float>(y - yTop)));
+            }
+            corner[4 * i + k] = n;
+        }
+    }
+
+    Mat latticeDesc = siftAtPoints(band, lattice, sigma * scale, sift);
+    CV_Assert(latticeDesc.rows == static_cast<int>(lattice.size()) && latticeDesc.cols == D);
+
+    Mat desc(numPoints, D, CV_32F);
+    for (int i = 0; i < numPoints; ++i) {
+        float* dst = desc.ptr<float>(i);
+        std::fill(dst, dst + D, 0.0f);
+        for (int k = 0; k < 4; ++k) {
+            const int n = corner[4 * i + k];
+            if (n < 0) continue;
+            const float w = weight[4 * i + k];
+            const float* s = latticeDesc.ptr<float>(n);
+            for (int c = 0; c < D; ++c) dst[c] += w * s[c];
+        }
+    }
+    return desc;
+}
+
+// Descriptors for grid rows [rowBegin, rowEnd). siftAtScale only hands SIFT
+// the rows the band's descriptors read (descriptorReach); for the full range
+// this is usually the whole padded image.
+DescriptorGrid generateDescriptorRows(const PaddedImage& image,
+    const SLSOptions& opts,
+    const Ptr<SIFT>& sift,
+    int rowBegin,
+    int rowEnd) {
+    DescriptorGrid out;
+    out.numPoints = 0;
+    out.s1 = out.s2 = 0;
+
+    if (image.padded.empty()) {
+        std::cerr << "generateDescriptors: input image is empty\n";
+        return out;
+    }
+
+    // A shared image may carry more border than these options need.
+    const int padSize = image.padSize;
+    CV_Assert(padSize >= descriptorPadSize(opts));
+    CV_Assert(image.padded.type() == CV_8UC1);
+
+    const int rows = image.padded.rows;
+    const int cols = image.padded.cols;
     const int gridSpacing = opts.gridSpacing;
 
+    const int gridCols = (cols - 2 * padSize + gridSpacing - 1) / gridSpacing;
+    const int gridRows = (rows - 2 * padSize + gridSpacing - 1) / gridSpacing;
+    rowBegin = std::max(rowBegin, 0);
+    rowEnd = std::min(rowEnd, gridRows);
+    if (rowBegin >= rowEnd) {
+        return out;
+    }
+
+    const int yFirst = padSize + rowBegin * gridSpacing;
+    const int yLast = padSize + (rowEnd - 1) * gridSpacing;
+
     // Build grid of coordinates inside padded region
     std::vector<Point2f> coords;
-    coords.reserve(((rows - 2 * padSize + gridSpacing - 1) / gridSpacing) *
-        ((cols - 2 * padSize + gridSpacing - 1) / gridSpacing));
+    coords.reserve(static_cast<size_t>(rowEnd - rowBegin) * gridCols);
 
-    for (int y = padSize; y < rows - padSize; y += gridSpacing) {
+    for (int y = yFirst; y <= yLast; y += gridSpacing) {
         for (int x = padSize; x < cols - padSize; x += gridSpacing) {
             coords.emplace_back(static_cast<float>(x), static_cast<float>(y));
         }
@@ -55,38 +328,14 @@ DescriptorGrid generateDescriptors(const Mat& grayImage, const SLSOptions& opts)
     const int D = 128;
 
     out.numPoints = numPoints;
-    out.s1 = (cols - 2 * padSize + gridSpacing - 1) / gridSpacing;
-    out.s2 = (rows - 2 * padSize + gridSpacing - 1) / gridSpacing;
+    out.s1 = gridCols;
+    out.s2 = rowEnd - rowBegin;
 
     out.dpMat = Mat::zeros(D, numPoints * numSigma, CV_32F);
 
-    // SIFT extractor
-    Ptr<SIFT> sift = SIFT::create();
-
-    // For each scale, build keypoints and compute descriptors
+    // For each scale, compute descriptors at every grid point
     for (int si = 0; si < numSigma; ++si) {
-        float sigma = opts.sigma[si];
-        float patchSize = 3.0f * sigma * (NBP + 1.0f);
-
-        std::vector<KeyPoint> keypoints;
-        keypoints.reserve(numPoints);
-
-        for (int i = 0; i < numPoints; ++i) {
-            KeyPoint kp;
-            kp.pt = coords[i];
-            kp.size = patchSize;
-            kp.angle = 0.0f;
-            keypoints.push_back(kp);
-        }
-
-        Mat desc;
-        sift->compute(padded, keypoints, desc);
-
-        if (desc.rows != numPoints || desc.cols != D) {
-            std::cerr << "generateDescriptors: unexpected SIFT size ("
-                << desc.rows << "x" << desc.cols << "), expected "
-                << numPoints << "x" << D << "\n";
-        }
+        Mat desc = siftAtScale(image, coords, opts.sigma[si], opts, sift);
 
         // Copy descriptors into dpMat.
         for (int i = 0; i < numPoints; ++i) {
@@ -98,3 +347,32 @@ DescriptorGrid generateDescriptors(const Mat& grayImage, const SLSOptions& opts)
 
     return out;
 }
+
+// Average descriptors across scales for each grid point
+// dp: D x (numPoints * numSigma), column layout = s + i * numSigma
+// Returns: D x numPoints
+Mat averageAcrossScales(const Mat& dp,
+    int numPoints,
+    int numSigma)
+{
+    CV_Assert(dp.cols == numPoints * numSigma);
+    const int D = dp.rows;
+
+    Mat desc(D, numPoints, CV_32F);
+    desc.setTo(0);
+
+    float invNumSigma = 1.0f / static_cast<float>(numSigma);
+
+    for (int i = 0; i < numPoints; ++i) {
+        Mat outCol = desc.col(i);
+        outCol.setTo(0);
+
+        for (int s = 0; s < numSigma; ++s) {
+            int colIdx = s + i * numSigma;
+            outCol += dp.col(colIdx);
+        }
+        outCol *= invNumSigma;
+    }
+
+    return desc;
+}
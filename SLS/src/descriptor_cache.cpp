@@ -0,0 +1,606 @@
+#include "sls/descriptor_cache.hpp"
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/core/utils/filesystem.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+
+namespace sls {
+
+    namespace {
+
+        // Bumped whenever the entry layout or what a key covers changes, so
+        // old entries simply stop matching.
+        const uint32_t kFormatVersion = 2;
+        const char kMagic[4] = { 'S', 'L', 'S', 'C' };
+
+        const char* const kGrid = "grid";
+        const char* const kPair = "pair";
+        const char* const kDesc = "desc";
+
+        inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+        inline uint64_t mix64(uint64_t x)
+        {
+            x ^= x >> 30;
+            x *= 0xBF58476D1CE4E5B9ULL;
+            x ^= x >> 27;
+            x *= 0x94D049BB133111EBULL;
+            x ^= x >> 31;
+            return x;
+        }
+
+        // Two 64-bit lanes over 8-byte words: fast enough that hashing an
+        // image costs a small fraction of decoding it, and 128 bits keep
+        // accidental collisions out of reach. Not meant to resist attacks.
+        class Hasher {
+        public:
+            Hasher() : a(0x9E3779B97F4A7C15ULL), b(0xC2B2AE3D27D4EB4FULL), length(0) {}
+
+            void update(const void* data, size_t n)
+            {
+                const unsigned char* p = static_cast<const unsigned char*>(data);
+                length += n;
+                for (; n >= 8; n -= 8, p += 8) {
+                    uint64_t w;
+                    std::memcpy(&w, p, 8);
+                    mixWord(w);
+                }
+                // Partial word, tagged with its length.
+                uint64_t w = static_cast<uint64_t>(n) << 56;
+                for (size_t i = 0; i < n; ++i) w |= static_cast<uint64_t>(p[i]) << (8 * i);
+                mixWord(w);
+            }
+
+            void add(int64_t v) { update(&v, sizeof(v)); }
+            void add(const std::string& s)
+            {
+                add(static_cast<int64_t>(s.size()));
+                update(s.data(), s.size());
+            }
+
+            std::string hex() const
+            {
+                const uint64_t h1 = mix64(a ^ length);
+                const uint64_t h2 = mix64(b ^ h1);
+                char buf[33];
+                std::snprintf(buf, sizeof(buf), "%016llx%016llx",
+                    static_cast<unsigned long long>(h1), static_cast<unsigned long long>(h2));
+                return buf;
+            }
+
+        private:
+            void mixWord(uint64_t w)
+            {
+                a ^= w * 0x87C37B91114253D5ULL;
+                a = rotl(a, 31) * 0x4CF5AD432745937FULL;
+                b += w ^ 0x52DCE729DA3ED9A5ULL;
+                b = rotl(b, 27) * 0x87C37B91114253D5ULL + a;
+            }
+
+            uint64_t a, b, length;
+        };
+
+        void hashMat(Hasher& h, const cv::Mat& m)
+        {
+            h.add(static_cast<int64_t>(m.type()));
+            h.add(static_cast<int64_t>(m.rows));
+            h.add(static_cast<int64_t>(m.cols));
+            const size_t rowBytes = m.cols * m.elemSize();
+            for (int r = 0; r < m.rows; ++r) h.update(m.ptr(r), rowBytes);
+        }
+
+        // What the SIFT grid depends on (padding follows from sigma and
+        // octaveSigma).
+        void hashGridOptions(Hasher& h, const SLSOptions& opts)
+        {
+            h.add(static_cast<int64_t>(opts.sigma.size()));
+            if (!opts.sigma.empty()) h.update(&opts.sigma[0], opts.sigma.size() * sizeof(float));
+            h.add(static_cast<int64_t>(opts.gridSpacing));
+            h.update(&opts.octaveSigma, sizeof(opts.octaveSigma));
+        }
+
+        // What produced the SIFT values: the OpenCV build and the SIFT
+        // instance's parameters. An empty pointer stands for SIFT::create().
+        void hashExtractor(Hasher& h, const cv::Ptr<cv::SIFT>& sift)
+        {
+            static const cv::Ptr<cv::SIFT> defaultSift = cv::SIFT::create();
+            const cv::SIFT& s = sift ? *sift : *defaultSift;
+            h.add(std::string(CV_VERSION));
+            h.add(static_cast<int64_t>(s.getNFeatures()));
+            h.add(static_cast<int64_t>(s.getNOctaveLayers()));
+            const double params[3] = { s.getContrastThreshold(), s.getEdgeThreshold(), s.getSigma() };
+            h.update(params, sizeof(params));
+            h.add(static_cast<int64_t>(s.descriptorType()));
+        }
+
+        // --- Entry encoding: magic, version, then fields in a fixed order ---
+
+        void putI32(std::string& s, int32_t v) { s.append(reinterpret_cast<const char*>(&v), sizeof(v)); }
+
+        void putMat(std::string& s, const cv::Mat& m)
+        {
+            putI32(s, m.type());
+            putI32(s, m.rows);
+            putI32(s, m.cols);
+            const size_t rowBytes = m.cols * m.elemSize();
+            for (int r = 0; r < m.rows; ++r) s.append(reinterpret_cast<const char*>(m.ptr(r)), rowBytes);
+        }
+
+        std::string header()
+        {
+            std::string s(kMagic, sizeof(kMagic));
+            putI32(s, static_cast<int32_t>(kFormatVersion));
+            return s;
+        }
+
+        struct Reader {
+            const std::string& s;
+            size_t pos;
+
+            bool i32(int32_t& v)
+            {
+                if (pos + sizeof(v) > s.size()) return false;
+                std::memcpy(&v, s.data() + pos, sizeof(v));
+                pos += sizeof(v);
+                return true;
+            }
+
+            bool mat(cv::Mat& m)
+            {
+                int32_t type, rows, cols;
+                if (!i32(type) || !i32(rows) || !i32(cols)) return false;
+                if (rows < 0 || cols < 0 || CV_MAT_CN(type) != 1 || CV_MAT_DEPTH(type) > CV_64F) return false;
+                const size_t bytes = static_cast<size_t>(rows) * cols * CV_ELEM_SIZE(type);
+                if (pos + bytes > s.size()) return false;
+                m.create(rows, cols, type);
+                if (bytes > 0) std::memcpy(m.data, s.data() + pos, bytes);
+                pos += bytes;
+                return true;
+            }
+
+            bool header()
+            {
+                int32_t version;
+                if (s.size() < sizeof(kMagic) || std::memcmp(s.data(), kMagic, sizeof(kMagic)) != 0) return false;
+                pos = sizeof(kMagic);
+                return i32(version) && version == static_cast<int32_t>(kFormatVersion);
+            }
+        };
+
+        // SIFT values are integers in [0, 255]; keep grids as 8-bit on disk
+        // when that is lossless (a quarter of the float size).
+        cv::Mat compactGrid(const cv::Mat& dp)
+        {
+            if (dp.type() != CV_32F) return dp;
+            cv::Mat u8, back;
+            dp.convertTo(u8, CV_8U);
+            u8.convertTo(back, CV_32F);
+            return cv::norm(dp, back, cv::NORM_INF) == 0.0 ? u8 : dp;
+        }
+
+        bool fileInfo(const std::string& path, int64_t& bytes, int64_t& mtime)
+        {
+#if defined(_WIN32)
+            struct _stat64 st;
+            if (_stat64(path.c_str(), &st) != 0) return false;
+#else
+            struct stat st;
+            if (stat(path.c_str(), &st) != 0) return false;
+#endif
+            bytes = static_cast<int64_t>(st.st_size);
+            mtime = static_cast<int64_t>(st.st_mtime);
+            return true;
+        }
+
+        void touchFile(const std::string& path)
+        {
+#if defined(_WIN32)
+            _utime(path.c_str(), nullptr);
+#else
+            utime(path.c_str(), nullptr);
+#endif
+        }
+
+        bool isEntryFile(const std::string& path)
+        {
+            size_t dot = path.find_last_of('.');
+            if (dot == std::string::npos) return false;
+            const std::string ext = path.substr(dot + 1);
+            return ext == kGrid || ext == kPair || ext == kDesc;
+        }
+
+        // Recency stamp: seconds (comparable with file mtimes) with room for
+        // ordering uses within the same second.
+        int64_t useStamp()
+        {
+            static std::atomic<int64_t> seq(0);
+            return static_cast<int64_t>(std::time(nullptr)) * 1000000 + (seq++ % 1000000);
+        }
+
+        std::mutex globalMtx;
+        std::shared_ptr<DescriptorCache> globalCache;
+        bool globalInitialized = false;
+    }
+
+    DescriptorCache::DescriptorCache(const CacheParams& params)
+        : cacheParams(params),
+        totalBytes(0),
+        hits(0),
+        misses(0),
+        evictions(0),
+        storesSinceScan(0)
+    {
+        if (!cacheParams.dir.empty()) {
+            cv::utils::fs::createDirectories(cacheParams.dir);
+        }
+        std::lock_guard<std::mutex> lock(mtx);
+        rescanLocked();
+    }
+
+    std::string DescriptorCache::imageKey(const cv::Mat& image)
+    {
+        Hasher h;
+        h.add(std::string("image"));
+        hashMat(h, image);
+        return h.hex();
+    }
+
+    std::string DescriptorCache::basisKey(const cv::Mat& pcaBasis)
+    {
+        if (pcaBasis.empty()) return "raw";
+        Hasher h;
+        h.add(std::string("basis"));
+        hashMat(h, pcaBasis);
+        return h.hex();
+    }
+
+    std::string DescriptorCache::gridKey(const std::string& imageKey,
+        const SLSOptions& opts,
+        const cv::Ptr<cv::SIFT>& sift)
+    {
+        Hasher h;
+        h.add(static_cast<int64_t>(kFormatVersion));
+        h.add(std::string(kGrid));
+        h.add(imageKey);
+        hashGridOptions(h, opts);
+        hashExtractor(h, sift);
+        return h.hex();
+    }
+
+    std::string DescriptorCache::pairKey(const std::string& imageKey1,
+        const std::string& imageKey2,
+        const SLSOptions& opts)
+    {
+        Hasher h;
+        h.add(static_cast<int64_t>(kFormatVersion));
+        h.add(std::string(kPair));
+        h.add(imageKey1);
+        h.add(imageKey2);
+        hashGridOptions(h, opts);
+        hashExtractor(h, cv::Ptr<cv::SIFT>());
+        h.add(static_cast<int64_t>(opts.dimReduction));
+        h.add(static_cast<int64_t>(opts.dimReductionCov));
+        h.add(static_cast<int64_t>(opts.subsDim));
+        return h.hex();
+    }
+
+    std::string DescriptorCache::descKey(const std::string& imageKey,
+        const SLSOptions& opts,
+        const std::string& basisKey)
+    {
+        Hasher h;
+        h.add(static_cast<int64_t>(kFormatVersion));
+        h.add(std::string(kDesc));
+        h.add(imageKey);
+        hashGridOptions(h, opts);
+        hashExtractor(h, cv::Ptr<cv::SIFT>());
+        h.add(basisKey);
+        return h.hex();
+    }
+
+    std::string DescriptorCache::pathFor(const std::string& key, const char* kind) const
+    {
+        // Two-character fan-out keeps directories small.
+        return cacheParams.dir + "/" + key.substr(0, 2) + "/" + key + "." + kind;
+    }
+
+    bool DescriptorCache::readEntry(const std::string& key, const char* kind, std::string& data)
+    {
+        const std::string path = pathFor(key, kind);
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            std::lock_guard<std::mutex> lock(mtx);
+            ++misses;
+            return false;
+        }
+        data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        touchFile(path);
+
+        std::lock_guard<std::mutex> lock(mtx);
+        ++hits;
+        std::map<std::string, Entry>::iterator it = entries.find(path);
+        if (it == entries.end()) {
+            // Written by another process since the last scan.
+            Entry e;
+            e.bytes = static_cast<int64_t>(data.size());
+            e.lastUse = useStamp();
+            entries[path] = e;
+            totalBytes += e.bytes;
+        }
+        else {
+            it->second.lastUse = useStamp();
+        }
+        return true;
+    }
+
+    void DescriptorCache::writeEntry(const std::string& key, const char* kind, const std::string& data)
+    {
+        const int64_t bytes = static_cast<int64_t>(data.size());
+        if (cacheParams.dir.empty() || bytes > cacheParams.maxBytes) return;
+
+        const std::string path = pathFor(key, kind);
+        cv::utils::fs::createDirectories(cacheParams.dir + "/" + key.substr(0, 2));
+
+        // Unique temporary name, then rename: concurrent readers (and other
+        // processes writing the same key) never see a partial entry.
+        std::ostringstream tag;
+        tag << std::this_thread::get_id() << "." << useStamp();
+        const std::string tmp = path + ".tmp." + tag.str();
+        {
+            std::ofstream out(tmp, std::ios::binary);
+            if (!out) return;
+            out.write(data.data(), data.size());
+            if (!out) {
+                out.close();
+                std::remove(tmp.c_str());
+                return;
+            }
+        }
+#if defined(_WIN32)
+        std::remove(path.c_str());   // rename does not replace on Windows
+#endif
+        if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+            std::remove(tmp.c_str());
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mtx);
+        Entry& e = entries[path];
+        totalBytes += bytes - e.bytes;
+        e.bytes = bytes;
+        e.lastUse = useStamp();
+
+        // Other processes add entries too; re-read the directory now and
+        // then so the size limit holds for the whole cache.
+        if (++storesSinceScan >= 64 || totalBytes > cacheParams.maxBytes) {
+            rescanLocked();
+        }
+        evictLocked();
+    }
+
+    void DescriptorCache::rescanLocked()
+    {
+        storesSinceScan = 0;
+        if (cacheParams.dir.empty() || !cv::utils::fs::isDirectory(cacheParams.dir)) {
+            entries.clear();
+            totalBytes = 0;
+            return;
+        }
+
+        std::vector<cv::String> files;
+        cv::utils::fs::glob(cacheParams.dir, "*", files, true);
+
+        std::map<std::string, Entry> scanned;
+        int64_t total = 0;
+        for (const cv::String& f : files) {
+            const std::string path = f;
+            if (!isEntryFile(path)) continue;
+            Entry e;
+            int64_t mtime;
+            if (!fileInfo(path, e.bytes, mtime)) continue;
+            e.lastUse = mtime * 1000000;
+            std::map<std::string, Entry>::const_iterator known = entries.find(path);
+            if (known != entries.end()) e.lastUse = std::max(e.lastUse, known->second.lastUse);
+            scanned[path] = e;
+            total += e.bytes;
+        }
+        entries.swap(scanned);
+        totalBytes = total;
+    }
+
+    void DescriptorCache::evictLocked()
+    {
+        if (totalBytes <= cacheParams.maxBytes) return;
+
+        // Trim to 90% of the limit so a full cache does not evict on every store.
+        const int64_t target = cacheParams.maxBytes - cacheParams.maxBytes / 10;
+        std::vector<std::pair<int64_t, std::string> > byAge;
+        byAge.reserve(entries.size());
+        for (const auto& kv : entries) byAge.push_back(std::make_pair(kv.second.lastUse, kv.first));
+        std::sort(byAge.begin(), byAge.end());
+
+        for (size_t i = 0; i < byAge.size() && totalBytes > target; ++i) {
+            std::map<std::string, Entry>::iterator it = entries.find(byAge[i].second);
+            std::remove(it->first.c_str());
+            totalBytes -= it->second.bytes;
+            entries.erase(it);
+            ++evictions;
+        }
+    }
+
+    bool DescriptorCache::loadGrid(const std::string& key, DescriptorGrid& grid)
+    {
+        std::string data;
+        if (!readEntry(key, kGrid, data)) return false;
+
+        Reader r = { data, 0 };
+        int32_t numPoints, s1, s2;
+        cv::Mat dp;
+        if (!r.header() || !r.i32(numPoints) || !r.i32(s1) || !r.i32(s2) || !r.mat(dp)) {
+            std::cerr << "DescriptorCache: dropping unreadable entry " << pathFor(key, kGrid) << "\n";
+            std::remove(pathFor(key, kGrid).c_str());
+            return false;
+        }
+        if (dp.type() != CV_32F) dp.convertTo(dp, CV_32F);
+        grid.dpMat = dp;
+        grid.numPoints = numPoints;
+        grid.s1 = s1;
+        grid.s2 = s2;
+        return true;
+    }
+
+    void DescriptorCache::storeGrid(const std::string& key, const DescriptorGrid& grid)
+    {
+        if (grid.dpMat.empty()) return;
+        std::string data = header();
+        putI32(data, grid.numPoints);
+        putI32(data, grid.s1);
+        putI32(data, grid.s2);
+        putMat(data, compactGrid(grid.dpMat));
+        writeEntry(key, kGrid, data);
+    }
+
+    bool DescriptorCache::loadPair(const std::string& key, SLSOutput& out)
+    {
+        std::string data;
+        if (!readEntry(key, kPair, data)) return false;
+
+        Reader r = { data, 0 };
+        int32_t w1, h1, w2, h2;
+        SLSOutput o;
+        if (!r.header() || !r.i32(w1) || !r.i32(h1) || !r.i32(w2) || !r.i32(h2)
+            || !r.mat(o.desc1) || !r.mat(o.desc2) || !r.mat(o.pcaBasis)) {
+            std::cerr << "DescriptorCache: dropping unreadable entry " << pathFor(key, kPair) << "\n";
+            std::remove(pathFor(key, kPair).c_str());
+            return false;
+        }
+        o.grid1 = cv::Size(w1, h1);
+        o.grid2 = cv::Size(w2, h2);
+        out = o;
+        return true;
+    }
+
+    void DescriptorCache::storePair(const std::string& key, const SLSOutput& out)
+    {
+        if (out.desc1.empty() || out.desc2.empty()) return;
+        std::string data = header();
+        putI32(data, out.grid1.width);
+        putI32(data, out.grid1.height);
+        putI32(data, out.grid2.width);
+        putI32(data, out.grid2.height);
+        putMat(data, out.desc1);
+        putMat(data, out.desc2);
+        putMat(data, out.pcaBasis);
+        writeEntry(key, kPair, data);
+    }
+
+    bool DescriptorCache::loadDesc(const std::string& key, cv::Mat& desc, cv::Size& grid)
+    {
+        std::string data;
+        if (!readEntry(key, kDesc, data)) return false;
+
+        Reader r = { data, 0 };
+        int32_t w, h;
+        cv::Mat d;
+        if (!r.header() || !r.i32(w) || !r.i32(h) || !r.mat(d)) {
+            std::cerr << "DescriptorCache: dropping unreadable entry " << pathFor(key, kDesc) << "\n";
+            std::remove(pathFor(key, kDesc).c_str());
+            return false;
+        }
+        desc = d;
+        grid = cv::Size(w, h);
+        return true;
+    }
+
+    void DescriptorCache::storeDesc(const std::string& key, const cv::Mat& desc, const cv::Size& grid)
+    {
+        if (desc.empty()) return;
+        std::string data = header();
+        putI32(data, grid.width);
+        putI32(data, grid.height);
+        putMat(data, desc);
+        writeEntry(key, kDesc, data);
+    }
+
+    void DescriptorCache::trim()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        rescanLocked();
+        evictLocked();
+    }
+
+    void DescriptorCache::clear()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        rescanLocked();
+        for (const auto& kv : entries) std::remove(kv.first.c_str());
+        evictions += static_cast<int64_t>(entries.size());
+        entries.clear();
+        totalBytes = 0;
+    }
+
+    CacheStats DescriptorCache::stats()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        CacheStats s;
+        s.entries = static_cast<int64_t>(entries.size());
+        s.bytes = totalBytes;
+        s.hits = hits;
+        s.misses = misses;
+        s.evictions = evictions;
+        return s;
+    }
+
+    void enableDescriptorCache(const CacheParams& params)
+    {
+        std::shared_ptr<DescriptorCache> cache;
+        if (!params.dir.empty()) cache = std::make_shared<DescriptorCache>(params);
+        std::lock_guard<std::mutex> lock(globalMtx);
+        globalCache = cache;
+        globalInitialized = true;
+    }
+
+    void disableDescriptorCache()
+    {
+        std::lock_guard<std::mutex> lock(globalMtx);
+        globalCache.reset();
+        globalInitialized = true;
+    }
+
+    std::shared_ptr<DescriptorCache> descriptorCache()
+    {
+        std::lock_guard<std::mutex> lock(globalMtx);
+        if (!globalInitialized) {
+            globalInitialized = true;
+            const char* dir = std::getenv("SLS_CACHE_DIR");
+            if (dir && *dir) {
+                CacheParams params;
+                params.dir = dir;
+                const char* mb = std::getenv("SLS_CACHE_MB");
+                if (mb && std::atoi(mb) > 0) params.maxBytes = static_cast<int64_t>(std::atoi(mb)) << 20;
+                globalCache = std::make_shared<DescriptorCache>(params);
+                std::cerr << "[CACHE] Using " << params.dir << " (limit "
+                    << (params.maxBytes >> 20) << " MB).\n";
+            }
+        }
+        return globalCache;
+    }
+}
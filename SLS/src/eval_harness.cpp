@@ -0,0 +1,314 @@
+#include "sls/eval_harness.hpp"
+#include "sls/dense_sift.hpp"
+#include "sls/sls_extractor.hpp"
+#include "sls/flow_upsample.hpp"
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#endif
+
+namespace sls {
+
+    namespace {
+
+        struct SyntheticPair {
+            cv::Mat src;
+            cv::Mat dst;
+            cv::Mat H;      // src -> dst
+            cv::Mat valid;  // src pixels whose image under H lies inside dst
+        };
+
+        cv::Mat toGray8U(const cv::Mat& img)
+        {
+            cv::Mat gray;
+            if (img.channels() > 1) {
+                cv::cvtColor(img, gray, cv::COLOR_BGR2GRAY);
+            }
+            else {
+                gray = img;
+            }
+            if (gray.depth() != CV_8U) {
+                gray.convertTo(gray, CV_8U, gray.depth() == CV_32F ? 255.0 : 1.0);
+            }
+            return gray;
+        }
+    }
+
+    size_t peakResidentBytes()
+    {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS pmc;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+            return static_cast<size_t>(pmc.PeakWorkingSetSize);
+        }
+        return 0;
+#else
+#if defined(__linux__)
+        // VmHWM, unlike ru_maxrss, follows resetPeakResident.
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.compare(0, 6, "VmHWM:") == 0) {
+                std::istringstream is(line.substr(6));
+                size_t kb = 0;
+                if (is >> kb) return kb * 1024;
+            }
+        }
+#endif
+        struct rusage ru;
+        if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+#if defined(__APPLE__)
+        return static_cast<size_t>(ru.ru_maxrss);
+#else
+        return static_cast<size_t>(ru.ru_maxrss) * 1024;
+#endif
+#endif
+    }
+
+    bool resetPeakResident()
+    {
+#if defined(__linux__)
+        std::ofstream clear("/proc/self/clear_refs");
+        clear << "5";
+        clear.flush();
+        return static_cast<bool>(clear);
+#else
+        return false;
+#endif
+    }
+
+    cv::Mat randomHomography(const cv::Size& size,
+        const HomographySampling& sampling,
+        cv::RNG& rng)
+    {
+        const double w = size.width;
+        const double h = size.height;
+        const double cx = 0.5 * w;
+        const double cy = 0.5 * h;
+
+        double s = std::pow(2.0, rng.uniform(-sampling.maxLog2Scale, sampling.maxLog2Scale));
+        double theta = rng.uniform(-sampling.maxRotationDeg, sampling.maxRotationDeg) * CV_PI / 180.0;
+        double px = rng.uniform(-sampling.maxPerspective, sampling.maxPerspective) / w;
+        double py = rng.uniform(-sampling.maxPerspective, sampling.maxPerspective) / h;
+        double tx = rng.uniform(-sampling.maxShiftFrac, sampling.maxShiftFrac) * w;
+        double ty = rng.uniform(-sampling.maxShiftFrac, sampling.maxShiftFrac) * h;
+
+        // Rotate, scale and apply the projective terms about the centre.
+        cv::Matx33d toCentre(1, 0, -cx, 0, 1, -cy, 0, 0, 1);
+        cv::Matx33d similarity(s * std::cos(theta), -s * std::sin(theta), 0,
+            s * std::sin(theta), s * std::cos(theta), 0,
+            0, 0, 1);
+        cv::Matx33d projective(1, 0, 0, 0, 1, 0, px, py, 1);
+        cv::Matx33d back(1, 0, cx + tx, 0, 1, cy + ty, 0, 0, 1);
+
+        cv::Matx33d H = back * projective * similarity * toCentre;
+        H *= 1.0 / H(2, 2);
+        return cv::Mat(H).clone();
+    }
+
+    std::vector<EvalRecord> runSyntheticEval(const std::vector<cv::Mat>& images,
+        const std::vector<EvalConfig>& configs,
+        const EvalParams& params)
+    {
+        std::vector<EvalRecord> records;
+
+        // Build all pairs up front so every configuration sees the same data.
+        cv::RNG rng(params.seed);
+        std::vector<SyntheticPair> pairs;
+        for (const cv::Mat& img : images) {
+            if (img.empty()) continue;
+            cv::Mat gray = toGray8U(img);
+            for (int k = 0; k < params.pairsPerImage; ++k) {
+                SyntheticPair p;
+                p.src = gray;
+                p.H = randomHomography(gray.size(), params.sampling, rng);
+                cv::warpPerspective(gray, p.dst, p.H, gray.size(),
+                    cv::INTER_LINEAR, cv::BORDER_REFLECT_101);
+                // dst content there is reflected border, so no flow is
+                // correct; sample a constant image at H * x to find them.
+                cv::Mat inside;
+                cv::warpPerspective(cv::Mat(gray.size(), CV_8U, cv::Scalar(255)), inside, p.H, gray.size(),
+                    cv::INTER_LINEAR | cv::WARP_INVERSE_MAP, cv::BORDER_CONSTANT, cv::Scalar(0));
+                p.valid = inside == 255;
+                pairs.push_back(p);
+            }
+        }
+
+        if (pairs.empty()) {
+            std::cerr << "runSyntheticEval: no usable input images.\n";
+            return records;
+        }
+
+        for (const EvalConfig& cfg : configs) {
+            std::cout << "[EVAL] Running configuration " << cfg.name
+                << " on " << pairs.size() << " pairs...\n";
+
+            EvalRecord rec;
+            rec.config = cfg.name;
+            rec.pairs = 0;
+            rec.accuracy = FlowEvalResult{};
+            rec.descriptorMB = 0.0;
+
+            double errSum = 0.0, below2 = 0.0, below5 = 0.0;
+            long long samples = 0;
+            double sampled = 0.0;
+            std::vector<float> errors;
+            double points = 0.0;
+            const int numSigma = static_cast<int>(cfg.opts.sigma.size());
+
+            cv::TickMeter tm;
+            const bool peakReset = resetPeakResident();
+
+            for (const SyntheticPair& p : pairs) {
+                tm.start();
+
+                cv::Mat desc1, desc2;
+                cv::Size grid;
+                if (cfg.useSLS) {
+                    SLSOutput o = extractScalelessDescs(p.src, p.dst, cfg.opts);
+                    desc1 = o.desc1;
+                    desc2 = o.desc2;
+                    grid = o.grid1;
+                }
+                else {
+                    DescriptorGrid g1 = generateDescriptors(p.src, cfg.opts);
+                    DescriptorGrid g2 = generateDescriptors(p.dst, cfg.opts);
+                    desc1 = averageAcrossScales(g1.dpMat, g1.numPoints, numSigma);
+                    desc2 = averageAcrossScales(g2.dpMat, g2.numPoints, numSigma);
+                    grid = cv::Size(g1.s1, g1.s2);
+                    rec.descriptorMB = std::max(rec.descriptorMB,
+                        (g1.dpMat.total() + g2.dpMat.total()) * sizeof(float) / (1024.0 * 1024.0));
+                }
+
+                if (desc1.empty() || desc2.empty()) {
+                    tm.stop();
+                    continue;
+                }
+                rec.descriptorMB = std::max(rec.descriptorMB,
+                    (desc1.total() + desc2.total()) * sizeof(float) / (1024.0 * 1024.0));
+
+                cv::Mat img1 = gridDescriptorsToImage(desc1, grid.width, grid.height);
+                cv::Mat img2 = gridDescriptorsToImage(desc2, grid.width, grid.height);
+
+                cv::Mat gridFlow;
+                if (cfg.regularize) {
+                    SGMParams sgm = cfg.sgm;
+                    sgm.windowRadius = cfg.windowRadius;
+                    gridFlow = computeDenseFlowSGM(img1, img2, sgm);
+                }
+                else {
+                    gridFlow = computeDenseFlowLocal(img1, img2, cfg.windowRadius);
+                }
+                if (gridFlow.empty()) {
+                    tm.stop();
+                    continue;
+                }
+
+                FlowUpsampleParams up;
+                up.gridSpacing = cfg.opts.gridSpacing;
+                cv::Mat flow = upsampleFlow(gridFlow, p.src, up);
+
+                tm.stop();
+
+                FlowEvalResult e = evaluateFlowAgainstHomography(flow, p.H, params.evalStep, &errors, p.valid);
+                sampled += static_cast<double>((flow.rows + params.evalStep - 1) / params.evalStep)
+                    * ((flow.cols + params.evalStep - 1) / params.evalStep);
+                errSum += e.meanError * e.numSamples;
+                below2 += e.percentBelow2px * e.numSamples;
+                below5 += e.percentBelow5px * e.numSamples;
+                samples += e.numSamples;
+                points += 2.0 * grid.area();
+                ++rec.pairs;
+            }
+
+            if (samples > 0) {
+                rec.accuracy.meanError = errSum / samples;
+                const size_t mid = errors.size() / 2;
+                std::nth_element(errors.begin(), errors.begin() + mid, errors.end());
+                rec.accuracy.medianError = errors[mid];
+                if (errors.size() % 2 == 0) {
+                    const float below = *std::max_element(errors.begin(), errors.begin() + mid);
+                    rec.accuracy.medianError = 0.5 * (below + rec.accuracy.medianError);
+                }
+                rec.accuracy.percentBelow2px = below2 / samples;
+                rec.accuracy.percentBelow5px = below5 / samples;
+            }
+            rec.accuracy.numSamples = static_cast<int>(samples);
+            rec.accuracy.validFraction = sampled > 0.0 ? samples / sampled : 0.0;
+            rec.wallMs = tm.getTimeMilli();
+            rec.pointsPerSec = rec.wallMs > 0.0 ? points / (rec.wallMs / 1000.0) : 0.0;
+            rec.peakRssMB = peakReset ? peakResidentBytes() / (1024.0 * 1024.0) : -1.0;
+
+            records.push_back(rec);
+        }
+
+        return records;
+    }
+
+    void printEvalReport(std::ostream& os, const std::vector<EvalRecord>& records)
+    {
+        os << std::left << std::setw(22) << "config"
+            << std::right << std::setw(6) << "pairs"
+            << std::setw(10) << "mean"
+            << std::setw(10) << "median"
+            << std::setw(9) << "<=2px"
+            << std::setw(9) << "<=5px"
+            << std::setw(8) << "valid"
+            << std::setw(12) << "wall ms"
+            << std::setw(12) << "points/s"
+            << std::setw(10) << "desc MB"
+            << std::setw(10) << "peak MB" << "\n";
+
+        os << std::fixed;
+        for (const EvalRecord& r : records) {
+            os << std::left << std::setw(22) << r.config
+                << std::right << std::setw(6) << r.pairs
+                << std::setprecision(2)
+                << std::setw(10) << r.accuracy.meanError
+                << std::setw(10) << r.accuracy.medianError
+                << std::setprecision(1)
+                << std::setw(8) << r.accuracy.percentBelow2px << "%"
+                << std::setw(8) << r.accuracy.percentBelow5px << "%"
+                << std::setw(7) << 100.0 * r.accuracy.validFraction << "%"
+                << std::setw(12) << r.wallMs
+                << std::setprecision(0)
+                << std::setw(12) << r.pointsPerSec
+                << std::setprecision(1)
+                << std::setw(10) << r.descriptorMB
+                << std::setw(10);
+            if (r.peakRssMB >= 0.0) os << r.peakRssMB;
+            else os << "-";
+            os << "\n";
+        }
+        os.unsetf(std::ios::fixed);
+    }
+
+    void writeEvalCsv(std::ostream& os, const std::vector<EvalRecord>& records)
+    {
+        os << "config,pairs,samples,valid_frac,mean_px,median_px,pct_le_2px,pct_le_5px,"
+            "wall_ms,points_per_s,descriptor_mb,peak_rss_mb\n";
+        for (const EvalRecord& r : records) {
+            os << r.config << ',' << r.pairs << ',' << r.accuracy.numSamples << ','
+                << r.accuracy.validFraction << ','
+                << r.accuracy.meanError << ',' << r.accuracy.medianError << ','
+                << r.accuracy.percentBelow2px << ',' << r.accuracy.percentBelow5px << ','
+                << r.wallMs << ',' << r.pointsPerSec << ','
+                << r.descriptorMB << ',' << r.peakRssMB << '\n';
+        }
+    }
+}
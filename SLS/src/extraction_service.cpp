@@ -0,0 +1,660 @@
+#include "sls/extraction_service.hpp"
+#include "sls/batch.hpp"
+#include "sls/dense_sift.hpp"
+#include "sls/descriptor_cache.hpp"
+#include "sls/ingest.hpp"
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <afunix.h>
+#pragma comment(lib, "Ws2_32.lib")
+typedef SOCKET socket_t;
+static const socket_t kInvalidSocket = INVALID_SOCKET;
+static void closeSocket(socket_t s) { closesocket(s); }
+static void shutdownSocket(socket_t s) { shutdown(s, SD_BOTH); }
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+typedef int socket_t;
+static const socket_t kInvalidSocket = -1;
+static void closeSocket(socket_t s) { ::close(s); }
+static void shutdownSocket(socket_t s) { shutdown(s, SHUT_RDWR); }
+#endif
+
+#if defined(MSG_NOSIGNAL)
+static const int kSendFlags = MSG_NOSIGNAL;
+#else
+static const int kSendFlags = 0;
+#endif
+
+namespace sls {
+
+    namespace {
+
+        const uint32_t kMagic = 0x31534c53u;          // "SLS1"
+        const uint32_t kMaxBlob = 1u << 30;           // sanity limit per field
+
+        void ensureSocketsInitialized()
+        {
+#if defined(_WIN32)
+            static bool ok = []() {
+                WSADATA data;
+                return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+            }();
+            (void)ok;
+#endif
+        }
+
+        bool sendAll(socket_t s, const void* data, size_t size)
+        {
+            const char* p = static_cast<const char*>(data);
+            while (size > 0) {
+                int chunk = static_cast<int>(std::min<size_t>(size, 1 << 20));
+                int n = static_cast<int>(send(s, p, chunk, kSendFlags));
+                if (n <= 0) return false;
+                p += n;
+                size -= static_cast<size_t>(n);
+            }
+            return true;
+        }
+
+        bool recvAll(socket_t s, void* data, size_t size)
+        {
+            char* p = static_cast<char*>(data);
+            while (size > 0) {
+                int chunk = static_cast<int>(std::min<size_t>(size, 1 << 20));
+                int n = static_cast<int>(recv(s, p, chunk, 0));
+                if (n <= 0) return false;
+                p += n;
+                size -= static_cast<size_t>(n);
+            }
+            return true;
+        }
+
+        // --- Message encoding: host byte order, the peer is always local ---
+
+        struct Writer {
+            std::vector<char> buf;
+
+            void raw(const void* p, size_t n)
+            {
+                const char* c = static_cast<const char*>(p);
+                buf.insert(buf.end(), c, c + n);
+            }
+            void u32(uint32_t v) { raw(&v, sizeof(v)); }
+            void i32(int32_t v) { raw(&v, sizeof(v)); }
+            void f64(double v) { raw(&v, sizeof(v)); }
+            void bytes(const void* p, size_t n)
+            {
+                u32(static_cast<uint32_t>(n));
+                if (n) raw(p, n);
+            }
+            void str(const std::string& s) { bytes(s.data(), s.size()); }
+            void mat(const cv::Mat& m)
+            {
+                cv::Mat c = m.isContinuous() ? m : m.clone();
+                i32(c.rows);
+                i32(c.cols);
+                i32(c.type());
+                if (!c.empty()) raw(c.data, c.total() * c.elemSize());
+            }
+        };
+
+        struct Reader {
+            socket_t s;
+
+            bool u32(uint32_t& v) { return recvAll(s, &v, sizeof(v)); }
+            bool i32(int32_t& v) { return recvAll(s, &v, sizeof(v)); }
+            bool f64(double& v) { return recvAll(s, &v, sizeof(v)); }
+            bool bytes(std::vector<uchar>& out)
+            {
+                uint32_t n;
+                if (!u32(n) || n > kMaxBlob) return false;
+                out.resize(n);
+                return n == 0 || recvAll(s, out.data(), n);
+            }
+            bool str(std::string& out)
+            {
+                uint32_t n;
+                if (!u32(n) || n > kMaxBlob) return false;
+                out.resize(n);
+                return n == 0 || recvAll(s, &out[0], n);
+            }
+            bool mat(cv::Mat& m)
+            {
+                int32_t rows, cols, type;
+                if (!i32(rows) || !i32(cols) || !i32(type)) return false;
+                if (rows <= 0 || cols <= 0) {
+                    m.release();
+                    return true;
+                }
+                if (type < 0 || CV_MAT_CN(type) > CV_CN_MAX) return false;
+                const size_t size = static_cast<size_t>(rows) * cols * CV_ELEM_SIZE(type);
+                if (size > kMaxBlob) return false;
+                m.create(rows, cols, type);
+                return recvAll(s, m.data, size);
+            }
+        };
+
+        bool makeAddress(const std::string& path, sockaddr_un& addr)
+        {
+            std::memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            if (path.empty() || path.size() >= sizeof(addr.sun_path)) return false;
+            std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+            return true;
+        }
+
+        // Warm state shared by all requests with identical options.
+        struct WarmState {
+            BatchOptions           opts;
+            bool                   valid;
+            uint64_t               lastUse;    // dispatcher tick, for eviction
+            std::vector<cv::Ptr<cv::SIFT>> sifts;  // one per image slot of a batch
+            cv::PCA                pca;
+            cv::Mat                pcaBasis;
+            std::string            basisKey;   // DescriptorCache::basisKey of pcaBasis
+            bool                   pcaReady;
+
+            WarmState() : valid(false), lastUse(0), pcaReady(false) {}
+        };
+
+        struct Job {
+            ServiceRequest request;
+            ServiceReply   reply;
+            bool           done;
+
+            Job() : done(false) {}
+        };
+    }
+
+    struct ExtractionService::Impl {
+        ServiceParams params;
+
+        std::mutex mtx;
+        std::condition_variable queueCv;
+        std::condition_variable doneCv;
+        std::deque<std::shared_ptr<Job>> queue;
+        std::atomic<bool> stopping;
+
+        // Only touched by the dispatcher thread.
+        std::map<std::string, std::shared_ptr<WarmState>> warm;
+        uint64_t warmTick;
+        std::thread dispatcher;
+
+        // Connection threads are detached; activeConns counts the ones still
+        // running so run() can wait for them. listenFd is guarded by connMtx.
+        socket_t listenFd;
+        std::mutex connMtx;
+        std::condition_variable connCv;
+        std::set<socket_t> clients;
+        int activeConns;
+
+        explicit Impl(const ServiceParams& p)
+            : params(p), stopping(false), warmTick(0), listenFd(kInvalidSocket), activeConns(0)
+        {
+            params.maxBatch = std::max(1, params.maxBatch);
+            params.maxWarm = std::max(1, params.maxWarm);
+            dispatcher = std::thread(&Impl::dispatchLoop, this);
+        }
+
+        size_t countPending(const std::string& key) const
+        {
+            size_t n = 0;
+            for (const auto& j : queue) {
+                if (j->request.options == key) ++n;
+            }
+            return n;
+        }
+
+        void dispatchLoop()
+        {
+            std::unique_lock<std::mutex> lk(mtx);
+            for (;;) {
+                queueCv.wait(lk, [&] { return stopping.load() || !queue.empty(); });
+                if (queue.empty()) break;
+
+                const std::string key = queue.front()->request.options;
+                const size_t maxBatch = static_cast<size_t>(params.maxBatch);
+
+                // Give concurrent clients a moment to join this batch.
+                if (countPending(key) < maxBatch && params.batchWaitMs > 0) {
+                    queueCv.wait_for(lk, std::chrono::milliseconds(params.batchWaitMs),
+                        [&] { return stopping.load() || countPending(key) >= maxBatch; });
+                }
+
+                std::vector<std::shared_ptr<Job>> batch;
+                for (auto it = queue.begin(); it != queue.end() && batch.size() < maxBatch;) {
+                    if ((*it)->request.options == key) {
+                        batch.push_back(*it);
+                        it = queue.erase(it);
+                    }
+                    else {
+                        ++it;
+                    }
+                }
+
+                lk.unlock();
+                // A bad request must not take the service down, and its
+                // clients still need a reply.
+                std::string failure;
+                try {
+                    std::shared_ptr<WarmState> ws = warmFor(key);
+                    processBatch(batch, *ws);
+                }
+                catch (const std::exception& e) {
+                    failure = e.what();
+                }
+                catch (...) {
+                    failure = "unknown exception";
+                }
+                if (!failure.empty()) {
+                    std::cerr << "[SERVICE] Batch of " << batch.size() << " failed: " << failure << "\n";
+                    for (auto& job : batch) {
+                        job->reply = ServiceReply();
+                        job->reply.error = "processing failed: " + failure;
+                        job->reply.batchSize = static_cast<int>(batch.size());
+                    }
+                }
+                lk.lock();
+
+                for (auto& job : batch) job->done = true;
+                doneCv.notify_all();
+            }
+        }
+
+        std::shared_ptr<WarmState> warmFor(const std::string& key)
+        {
+            std::shared_ptr<WarmState>& ws = warm[key];
+            if (!ws) {
+                ws = std::make_shared<WarmState>();
+                ws->valid = parseBatchOptions(key, ws->opts);
+            }
+            ws->lastUse = ++warmTick;
+            std::shared_ptr<WarmState> current = ws;
+
+            while (warm.size() > static_cast<size_t>(params.maxWarm)) {
+                auto oldest = warm.begin();
+                for (auto it = warm.begin(); it != warm.end(); ++it) {
+                    if (it->second->lastUse < oldest->second->lastUse) oldest = it;
+                }
+                warm.erase(oldest);
+            }
+            return current;
+        }
+
+        // Fit the PCA basis once per options, from the first batch seen.
+        void ensurePCA(WarmState& ws, const std::vector<DescriptorGrid>& grids)
+        {
+            if (ws.pcaReady) return;
+
+            const SLSOptions& o = ws.opts.sls;
+            int D = 0;
+            long long totalCols = 0;
+            for (const auto& g : grids) {
+                if (g.dpMat.empty()) continue;
+                D = g.dpMat.rows;
+                totalCols += g.dpMat.cols;
+            }
+            if (D == 0) return;
+
+            if (o.dimReduction <= 0 || o.dimReduction >= D) {
+                ws.pcaBasis = cv::Mat::eye(D, D, CV_32F);
+                ws.basisKey = DescriptorCache::basisKey(ws.pcaBasis);
+                ws.pcaReady = true;
+                return;
+            }
+
+            // Evenly strided subsample of at most dimReductionCov columns.
+            const long long budget = o.dimReductionCov > 0 ? o.dimReductionCov : totalCols;
+            const long long stride = std::max<long long>(1, (totalCols + budget - 1) / budget);
+            cv::Mat samples;
+            for (const auto& g : grids) {
+                if (g.dpMat.empty()) continue;
+                cv::Mat t = g.dpMat.t();
+                for (int r = 0; r < t.rows; r += static_cast<int>(stride)) {
+                    samples.push_back(t.row(r));
+                }
+            }
+
+            ws.pca = cv::PCA(samples, cv::Mat(), cv::PCA::DATA_AS_ROW, o.dimReduction);
+            ws.pcaBasis = ws.pca.eigenvectors.clone();
+            ws.basisKey = DescriptorCache::basisKey(ws.pcaBasis);
+            ws.pcaReady = true;
+        }
+
+        std::string descKeyFor(const WarmState& ws, const std::string& imageKey)
+        {
+            const std::string basis = ws.opts.useSLS ? ws.basisKey : DescriptorCache::basisKey(cv::Mat());
+            return DescriptorCache::descKey(imageKey, ws.opts.sls, basis);
+        }
+
+        cv::Mat reduceAndAverage(const WarmState& ws, const DescriptorGrid& g)
+        {
+            const int numSigma = static_cast<int>(ws.opts.sls.sigma.size());
+            if (!ws.opts.useSLS || ws.pca.eigenvectors.empty()) {
+                return averageAcrossScales(g.dpMat, g.numPoints, numSigma);
+            }
+            cv::Mat proj;
+            ws.pca.project(g.dpMat.t(), proj);
+            cv::Mat projT = proj.t();
+            return averageAcrossScales(projT, g.numPoints, numSigma);
+        }
+
+        void processBatch(const std::vector<std::shared_ptr<Job>>& batch, WarmState& ws)
+        {
+            cv::TickMeter tm;
+            tm.start();
+
+            const int n = static_cast<int>(batch.size());
+            if (!ws.valid) {
+                for (auto& job : batch) job->reply.error = "invalid options";
+                return;
+            }
+
+            // Decode, resize and extract every image of the batch in parallel.
+            const int numImages = 2 * n;
+            while (static_cast<int>(ws.sifts.size()) < numImages) {
+                ws.sifts.push_back(cv::SIFT::create());
+            }
+
+            // Once the basis is fixed, reduced descriptors are cached per
+            // image under it, so repeated images skip extraction entirely.
+            std::shared_ptr<DescriptorCache> cache = descriptorCache();
+            const bool basisKnown = !ws.opts.useSLS || ws.pcaReady;
+            std::vector<std::string> imageKeys(numImages);
+            std::vector<cv::Mat> cachedDesc(numImages);
+            std::vector<cv::Size> cachedGrid(numImages);
+
+            std::vector<cv::Mat> gray(numImages);
+            std::vector<DescriptorGrid> grids(numImages);
+            cv::parallel_for_(cv::Range(0, numImages), [&](const cv::Range& r) {
+                for (int i = r.start; i < r.end; ++i) {
+                    const ServiceRequest& req = batch[i / 2]->request;
+                    const std::vector<uchar>& buf = (i % 2 == 0) ? req.image1 : req.image2;
+                    if (buf.empty()) continue;
+                    cv::Mat img = decodeGrayscale(buf, ws.opts.scaleFactor);
+                    if (img.empty()) continue;
+                    gray[i] = img;
+                    if (cache) {
+                        imageKeys[i] = DescriptorCache::imageKey(img);
+                        if (basisKnown && cache->loadDesc(descKeyFor(ws, imageKeys[i]), cachedDesc[i], cachedGrid[i])) {
+                            continue;
+                        }
+                    }
+                    grids[i] = generateDescriptors(img, ws.opts.sls, ws.sifts[i]);
+                }
+            });
+
+            if (ws.opts.useSLS) {
+                ensurePCA(ws, grids);
+            }
+
+            for (int j = 0; j < n; ++j) {
+                ServiceReply& reply = batch[j]->reply;
+                const DescriptorGrid& g1 = grids[2 * j];
+                const DescriptorGrid& g2 = grids[2 * j + 1];
+                if (gray[2 * j].empty() || gray[2 * j + 1].empty()) {
+                    reply.error = "could not decode request images";
+                    continue;
+                }
+                if ((g1.dpMat.empty() && cachedDesc[2 * j].empty())
+                    || (g2.dpMat.empty() && cachedDesc[2 * j + 1].empty())) {
+                    reply.error = "descriptor extraction produced no points";
+                    continue;
+                }
+
+                cv::Mat* desc[2] = { &reply.desc1, &reply.desc2 };
+                cv::Size* grid[2] = { &reply.grid1, &reply.grid2 };
+                for (int k = 0; k < 2; ++k) {
+                    const int i = 2 * j + k;
+                    if (!cachedDesc[i].empty()) {
+                        *desc[k] = cachedDesc[i];
+                        *grid[k] = cachedGrid[i];
+                        continue;
+                    }
+                    *desc[k] = reduceAndAverage(ws, grids[i]);
+                    *grid[k] = cv::Size(grids[i].s1, grids[i].s2);
+                    if (cache && (!ws.opts.useSLS || ws.pcaReady)) {
+                        cache->storeDesc(descKeyFor(ws, imageKeys[i]), *desc[k], *grid[k]);
+                    }
+                }
+                reply.pcaBasis = ws.pcaBasis;
+                if (ws.opts.flow.enabled) {
+                    reply.flow = computePairFlow(reply.desc1, reply.desc2,
+                        reply.grid1, reply.grid2, gray[2 * j], ws.opts);
+                }
+                reply.ok = true;
+            }
+
+            tm.stop();
+            for (auto& job : batch) {
+                job->reply.serverMs = tm.getTimeMilli();
+                job->reply.batchSize = n;
+            }
+        }
+
+        ServiceReply submit(const ServiceRequest& request)
+        {
+            auto job = std::make_shared<Job>();
+            job->request = request;
+
+            std::unique_lock<std::mutex> lk(mtx);
+            if (stopping.load()) {
+                job->reply.error = "service is stopping";
+                return job->reply;
+            }
+            queue.push_back(job);
+            queueCv.notify_all();
+            doneCv.wait(lk, [&] { return job->done; });
+            return job->reply;
+        }
+
+        void serveConnection(socket_t fd)
+        {
+            Reader in{ fd };
+            for (;;) {
+                uint32_t magic;
+                ServiceRequest req;
+                if (!in.u32(magic) || magic != kMagic) break;
+                if (!in.str(req.options) || !in.bytes(req.image1) || !in.bytes(req.image2)) break;
+
+                ServiceReply rep = submit(req);
+
+                Writer out;
+                out.u32(kMagic);
+                out.i32(rep.ok ? 1 : 0);
+                out.str(rep.error);
+                out.mat(rep.desc1);
+                out.mat(rep.desc2);
+                out.mat(rep.flow);
+                out.mat(rep.pcaBasis);
+                out.i32(rep.grid1.width);
+                out.i32(rep.grid1.height);
+                out.i32(rep.grid2.width);
+                out.i32(rep.grid2.height);
+                out.f64(rep.serverMs);
+                out.i32(rep.batchSize);
+                if (!sendAll(fd, out.buf.data(), out.buf.size())) break;
+            }
+
+            std::unique_lock<std::mutex> lk(connMtx);
+            if (clients.erase(fd)) closeSocket(fd);
+            --activeConns;
+            // The thread is detached: wake run() only once nothing of this
+            // object is touched any more.
+            std::notify_all_at_thread_exit(connCv, std::move(lk));
+        }
+    };
+
+    ExtractionService::ExtractionService(const ServiceParams& params)
+        : impl(new Impl(params))
+    {
+    }
+
+    ExtractionService::~ExtractionService()
+    {
+        stop();
+        if (impl->dispatcher.joinable()) impl->dispatcher.join();
+    }
+
+    bool ExtractionService::run()
+    {
+        ensureSocketsInitialized();
+
+        sockaddr_un addr;
+        if (!makeAddress(impl->params.socketPath, addr)) {
+            std::cerr << "ExtractionService: invalid socket path '"
+                << impl->params.socketPath << "'\n";
+            return false;
+        }
+
+        socket_t fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == kInvalidSocket) {
+            std::cerr << "ExtractionService: could not create socket\n";
+            return false;
+        }
+
+        // A stale socket file from a previous run would make bind fail.
+        std::remove(impl->params.socketPath.c_str());
+        if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+            std::cerr << "ExtractionService: could not listen on "
+                << impl->params.socketPath << "\n";
+            closeSocket(fd);
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lk(impl->connMtx);
+            if (impl->stopping.load()) {
+                closeSocket(fd);
+                std::remove(impl->params.socketPath.c_str());
+                return true;
+            }
+            impl->listenFd = fd;
+        }
+
+        std::cout << "[SERVICE] Listening on " << impl->params.socketPath
+            << " (max batch " << impl->params.maxBatch << ")" << std::endl;
+
+        while (!impl->stopping.load()) {
+            socket_t client = accept(fd, nullptr, nullptr);
+            if (client == kInvalidSocket) {
+                if (impl->stopping.load()) break;
+                continue;
+            }
+            std::lock_guard<std::mutex> lk(impl->connMtx);
+            impl->clients.insert(client);
+            ++impl->activeConns;
+            std::thread(&Impl::serveConnection, impl.get(), client).detach();
+        }
+
+        {
+            std::unique_lock<std::mutex> lk(impl->connMtx);
+            for (socket_t c : impl->clients) shutdownSocket(c);
+            impl->connCv.wait(lk, [&] { return impl->activeConns == 0; });
+            closeSocket(fd);
+            impl->listenFd = kInvalidSocket;
+        }
+        std::remove(impl->params.socketPath.c_str());
+        return true;
+    }
+
+    void ExtractionService::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lk(impl->mtx);
+            impl->stopping.store(true);
+        }
+        impl->queueCv.notify_all();
+        std::lock_guard<std::mutex> lk(impl->connMtx);
+        if (impl->listenFd != kInvalidSocket) {
+            shutdownSocket(impl->listenFd);
+        }
+    }
+
+    ServiceReply ExtractionService::submit(const ServiceRequest& request)
+    {
+        return impl->submit(request);
+    }
+
+    ServiceClient::ServiceClient() : fd(-1) {}
+
+    ServiceClient::~ServiceClient()
+    {
+        close();
+    }
+
+    bool ServiceClient::connect(const std::string& socketPath)
+    {
+        ensureSocketsInitialized();
+        close();
+
+        sockaddr_un addr;
+        if (!makeAddress(socketPath, addr)) return false;
+
+        socket_t s = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (s == kInvalidSocket) return false;
+        if (::connect(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            closeSocket(s);
+            return false;
+        }
+        fd = static_cast<long long>(s);
+        return true;
+    }
+
+    bool ServiceClient::request(const ServiceRequest& request, ServiceReply& reply)
+    {
+        if (fd < 0) return false;
+        socket_t s = static_cast<socket_t>(fd);
+
+        Writer out;
+        out.u32(kMagic);
+        out.str(request.options);
+        out.bytes(request.image1.data(), request.image1.size());
+        out.bytes(request.image2.data(), request.image2.size());
+        if (!sendAll(s, out.buf.data(), out.buf.size())) return false;
+
+        Reader in{ s };
+        uint32_t magic;
+        int32_t ok, w1, h1, w2, h2, batchSize;
+        if (!in.u32(magic) || magic != kMagic) return false;
+        if (!in.i32(ok) || !in.str(reply.error)) return false;
+        if (!in.mat(reply.desc1) || !in.mat(reply.desc2) ||
+            !in.mat(reply.flow) || !in.mat(reply.pcaBasis)) return false;
+        if (!in.i32(w1) || !in.i32(h1) || !in.i32(w2) || !in.i32(h2)) return false;
+        if (!in.f64(reply.serverMs) || !in.i32(batchSize)) return false;
+
+        reply.ok = ok != 0;
+        reply.grid1 = cv::Size(w1, h1);
+        reply.grid2 = cv::Size(w2, h2);
+        reply.batchSize = batchSize;
+        return true;
+    }
+
+    void ServiceClient::close()
+    {
+        if (fd >= 0) {
+            closeSocket(static_cast<socket_t>(fd));
+            fd = -1;
+        }
+    }
+}
@@ -0,0 +1,265 @@
+#include "sls/flow_sgm.hpp"
+#include <opencv2/opencv.hpp>
+#include <opencv2/core/hal/hal.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+namespace sls {
+
+    namespace {
+
+        typedef uint16_t cost_t;
+
+        // One SGM recurrence step for a single pixel:
+        //   Lr(p, d) = C(p, d) + min(Lr(p-r, d),
+        //                            min_{|d'-d|_inf = 1} Lr(p-r, d') + P1,
+        //                            min_d' Lr(p-r, d') + P2) - min_d' Lr(p-r, d')
+        // Labels form a (2R+1) x (2R+1) displacement grid, so the one-step
+        // neighbourhood minimum is a separable 3x3 min filter over `prev`.
+        // Costs and penalties are quantised; Lr <= C + P2, and the
+        // quantisation scale keeps numPaths * (Cmax + P2), rounding included,
+        // within 16 bits.
+        // Returns min_d Lr(p, d) for the next step.
+        int aggregatePixel(const cost_t* cost,
+            const cost_t* prev,
+            int prevMin,
+            cost_t* out,
+            cost_t* scratch,
+            int side,
+            int P1,
+            int P2)
+        {
+            const int L = side * side;
+
+            if (!prev) {
+                int m = std::numeric_limits<int>::max();
+                for (int l = 0; l < L; ++l) {
+                    out[l] = cost[l];
+                    m = std::min(m, static_cast<int>(cost[l]));
+                }
+                return m;
+            }
+
+            // Horizontal 3-tap min into scratch, vertical 3-tap min into out.
+            for (int b = 0; b < side; ++b) {
+                const cost_t* pr = prev + b * side;
+                cost_t* sr = scratch + b * side;
+                for (int a = 0; a < side; ++a) {
+                    cost_t m = pr[a];
+                    if (a > 0)        m = std::min(m, pr[a - 1]);
+                    if (a + 1 < side) m = std::min(m, pr[a + 1]);
+                    sr[a] = m;
+                }
+            }
+
+            const int jump = prevMin + P2;
+            int outMin = std::numeric_limits<int>::max();
+
+            for (int b = 0; b < side; ++b) {
+                const cost_t* s0 = scratch + std::max(b - 1, 0) * side;
+                const cost_t* s1 = scratch + b * side;
+                const cost_t* s2 = scratch + std::min(b + 1, side - 1) * side;
+                const cost_t* pr = prev + b * side;
+                const cost_t* cr = cost + b * side;
+                cost_t* orow = out + b * side;
+
+                for (int a = 0; a < side; ++a) {
+                    int nb = std::min(std::min(s0[a], s1[a]), s2[a]) + P1;
+                    int v = cr[a] + std::min(std::min(static_cast<int>(pr[a]), nb), jump) - prevMin;
+                    orow[a] = static_cast<cost_t>(v);
+                    outMin = std::min(outMin, v);
+                }
+            }
+            return outMin;
+        }
+
+        float descriptorCost(const cv::Mat& sourceDesc, const cv::Mat& targetDesc, int y, int x, int yy, int xx)
+        {
+            return std::sqrt(cv::hal::normL2Sqr_(sourceDesc.ptr<float>(y, x),
+                targetDesc.ptr<float>(yy, xx), sourceDesc.channels()));
+        }
+    }
+
+    cv::Mat computeDenseFlowSGM(
+        const cv::Mat& sourceDesc,
+        const cv::Mat& targetDesc,
+        const SGMParams& params)
+    {
+        CV_Assert(sourceDesc.size() == targetDesc.size());
+        CV_Assert(sourceDesc.type() == targetDesc.type());
+        CV_Assert(sourceDesc.depth() == CV_32F);
+        CV_Assert(params.windowRadius >= 0);
+        CV_Assert(params.numPaths == 4 || params.numPaths == 8);
+
+        const int H = sourceDesc.rows;
+        const int W = sourceDesc.cols;
+        const int R = params.windowRadius;
+        const int side = 2 * R + 1;
+        const int L = side * side;
+        const size_t numPix = static_cast<size_t>(H) * W;
+
+        // Cost and aggregated volumes, 16-bit each.
+        const double volumeMB = 2.0 * numPix * L * sizeof(cost_t) / (1024.0 * 1024.0);
+        if (params.maxVolumeMB > 0 && volumeMB > params.maxVolumeMB) {
+            std::cerr << "computeDenseFlowSGM: " << W << "x" << H << " grid with " << L
+                << " candidates needs " << static_cast<long long>(volumeMB) << " MB (limit "
+                << params.maxVolumeMB << " MB); use a coarser grid, a smaller window or "
+                << "the local flow mode.\n";
+            return cv::Mat();
+        }
+
+        // --- Cost statistics on a strided subset, for penalties and scale ---
+        const int sampleStep = std::max(1, std::min(4, std::min(H, W) / 8));
+        double costSum = 0.0;
+        long long costCount = 0;
+        float maxCost = 0.0f;
+        for (int y = 0; y < H; y += sampleStep) {
+            for (int x = 0; x < W; x += sampleStep) {
+                for (int dy = -R; dy <= R; ++dy) {
+                    const int yy = y + dy;
+                    if (yy < 0 || yy >= H) continue;
+                    for (int dx = -R; dx <= R; ++dx) {
+                        const int xx = x + dx;
+                        if (xx < 0 || xx >= W) continue;
+                        const float d = descriptorCost(sourceDesc, targetDesc, y, x, yy, xx);
+                        costSum += d;
+                        ++costCount;
+                        maxCost = std::max(maxCost, d);
+                    }
+                }
+            }
+        }
+        const float meanCost = costCount > 0 && costSum > 0.0
+            ? static_cast<float>(costSum / costCount) : 1.0f;
+        maxCost = std::max(maxCost, meanCost);
+
+        const float P1 = params.P1 > 0.0f ? params.P1 : 0.1f * meanCost;
+        const float P2 = params.P2 > 0.0f ? std::max(params.P2, P1) : std::max(0.4f * meanCost, P1);
+
+        // Out-of-image candidates cost more than any real match plus a jump,
+        // so they are only chosen when nothing else exists. Real costs above
+        // the sampled maximum are clamped to it.
+        const float outside = 2.0f * maxCost + P2 + 1.0f;
+
+        // Quantise so that the sum over all paths of Lr <= C + P2 fits 16 bits.
+        // Rounding can add half a unit to C and to P2, and max(1, .) on P1
+        // can lift P2 by one unit, so each path gets two units of slack.
+        const float scale = (65535.0f / params.numPaths - 2.0f) / (outside + P2);
+        const int P1q = std::max(1, cvRound(P1 * scale));
+        const int P2q = std::max(P1q, cvRound(P2 * scale));
+        const cost_t outsideQ = static_cast<cost_t>(cvRound(outside * scale));
+        const cost_t maxQ = static_cast<cost_t>(cvRound(maxCost * scale));
+
+        // --- Cost volume: L2 descriptor distance per (pixel, displacement) ---
+        std::vector<cost_t> cost(numPix * L);
+        cv::parallel_for_(cv::Range(0, H), [&](const cv::Range& band) {
+            for (int y = band.start; y < band.end; ++y) {
+                for (int x = 0; x < W; ++x) {
+                    cost_t* cp = &cost[(static_cast<size_t>(y) * W + x) * L];
+                    for (int dy = -R; dy <= R; ++dy) {
+                        const int yy = y + dy;
+                        for (int dx = -R; dx <= R; ++dx) {
+                            const int xx = x + dx;
+                            const int l = (dy + R) * side + (dx + R);
+                            if (yy < 0 || yy >= H || xx < 0 || xx >= W) {
+                                cp[l] = outsideQ;
+                                continue;
+                            }
+                            const float d = descriptorCost(sourceDesc, targetDesc, y, x, yy, xx);
+                            cp[l] = static_cast<cost_t>(std::min(static_cast<int>(maxQ), cvRound(d * scale)));
+                        }
+                    }
+                }
+            }
+        });
+
+        // --- Aggregation along scanlines ---
+        std::vector<cost_t> sum(numPix * L, 0);
+
+        static const int dirs8[8][2] = {
+            { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 },
+            { 1, 1 }, { -1, 1 }, { 1, -1 }, { -1, -1 }
+        };
+
+        for (int di = 0; di < params.numPaths; ++di) {
+            const int ddx = dirs8[di][0];
+            const int ddy = dirs8[di][1];
+
+            if (ddy == 0) {
+                // Horizontal paths: rows are independent.
+                cv::parallel_for_(cv::Range(0, H), [&](const cv::Range& band) {
+                    std::vector<cost_t> bufA(L), bufB(L), scratch(L);
+                    for (int y = band.start; y < band.end; ++y) {
+                        cost_t* prev = nullptr;
+                        cost_t* cur = bufA.data();
+                        int prevMin = 0;
+                        for (int i = 0; i < W; ++i) {
+                            const int x = ddx > 0 ? i : W - 1 - i;
+                            const size_t p = static_cast<size_t>(y) * W + x;
+                            prevMin = aggregatePixel(&cost[p * L], prev, prevMin,
+                                cur, scratch.data(), side, P1q, P2q);
+                            cost_t* s = &sum[p * L];
+                            for (int l = 0; l < L; ++l) s[l] = cv::saturate_cast<cost_t>(s[l] + cur[l]);
+                            prev = cur;
+                            cur = (cur == bufA.data()) ? bufB.data() : bufA.data();
+                        }
+                    }
+                });
+                continue;
+            }
+
+            // Vertical and diagonal paths: each row depends only on the
+            // previous one, so pixels within a row run in parallel.
+            std::vector<cost_t> prevRow(static_cast<size_t>(W) * L);
+            std::vector<cost_t> curRow(static_cast<size_t>(W) * L);
+            std::vector<int> prevRowMin(W, 0), curRowMin(W, 0);
+
+            for (int i = 0; i < H; ++i) {
+                const int y = ddy > 0 ? i : H - 1 - i;
+                const bool first = (i == 0);
+
+                cv::parallel_for_(cv::Range(0, W), [&](const cv::Range& cols) {
+                    std::vector<cost_t> scratch(L);
+                    for (int x = cols.start; x < cols.end; ++x) {
+                        const size_t p = static_cast<size_t>(y) * W + x;
+                        const int px = x - ddx;
+                        const bool hasPrev = !first && px >= 0 && px < W;
+                        const cost_t* prev = hasPrev ? &prevRow[static_cast<size_t>(px) * L] : nullptr;
+                        cost_t* cur = &curRow[static_cast<size_t>(x) * L];
+                        curRowMin[x] = aggregatePixel(&cost[p * L], prev,
+                            hasPrev ? prevRowMin[px] : 0,
+                            cur, scratch.data(), side, P1q, P2q);
+                        cost_t* s = &sum[p * L];
+                        for (int l = 0; l < L; ++l) s[l] = cv::saturate_cast<cost_t>(s[l] + cur[l]);
+                    }
+                });
+
+                prevRow.swap(curRow);
+                prevRowMin.swap(curRowMin);
+            }
+        }
+
+        // --- Winner-take-all on the aggregated volume ---
+        cv::Mat flow(H, W, CV_32FC2);
+        cv::parallel_for_(cv::Range(0, H), [&](const cv::Range& band) {
+            for (int y = band.start; y < band.end; ++y) {
+                cv::Vec2f* out = flow.ptr<cv::Vec2f>(y);
+                for (int x = 0; x < W; ++x) {
+                    const cost_t* s = &sum[(static_cast<size_t>(y) * W + x) * L];
+                    int best = 0;
+                    for (int l = 1; l < L; ++l) {
+                        if (s[l] < s[best]) best = l;
+                    }
+                    out[x][0] = static_cast<float>(best % side - R);
+                    out[x][1] = static_cast<float>(best / side - R);
+                }
+            }
+        });
+
+        return flow;
+    }
+}
@@ -0,0 +1,203 @@
+#include "sls/flow_upsample.hpp"
+#include "sls/simd.hpp"
+#include <opencv2/opencv.hpp>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+namespace sls {
+
+    namespace {
+
+        // For every pixel coordinate along one axis, the grid nodes that
+        // contribute to it and their tent weights (K = 2 * radius taps).
+        // With radius 1 this is plain bilinear interpolation. Stored tap-major
+        // (tap k of pixel p at k * numPixels + p) so consecutive pixels of one
+        // tap load as a vector.
+        struct AxisTaps {
+            int K;
+            std::vector<int>   node;
+            std::vector<float> weight;
+        };
+
+        AxisTaps buildAxisTaps(int numPixels, int numNodes, int spacing, int radius)
+        {
+            AxisTaps taps;
+            taps.K = 2 * radius;
+            taps.node.resize(static_cast<size_t>(numPixels) * taps.K);
+            taps.weight.resize(static_cast<size_t>(numPixels) * taps.K);
+
+            const float invSpacing = 1.0f / static_cast<float>(spacing);
+            const float invRadius = 1.0f / static_cast<float>(radius);
+
+            for (int p = 0; p < numPixels; ++p) {
+                float g = p * invSpacing;
+                int g0 = static_cast<int>(std::floor(g));
+                for (int k = 0; k < taps.K; ++k) {
+                    int n = g0 - radius + 1 + k;
+                    float w = std::max(0.0f, 1.0f - std::abs(g - n) * invRadius);
+                    // Nodes outside the grid replicate the border node.
+                    taps.node[static_cast<size_t>(k) * numPixels + p] = std::min(std::max(n, 0), numNodes - 1);
+                    taps.weight[static_cast<size_t>(k) * numPixels + p] = w;
+                }
+            }
+            return taps;
+        }
+
+        cv::Mat toGray8U(const cv::Mat& img)
+        {
+            cv::Mat gray;
+            if (img.channels() > 1) {
+                cv::cvtColor(img, gray, cv::COLOR_BGR2GRAY);
+            }
+            else {
+                gray = img;
+            }
+
+            if (gray.depth() == CV_32F || gray.depth() == CV_64F) {
+                gray.convertTo(gray, CV_8U, 255.0);
+            }
+            else if (gray.depth() != CV_8U) {
+                gray.convertTo(gray, CV_8U);
+            }
+            return gray;
+        }
+    }
+
+    cv::Mat upsampleFlow(const cv::Mat& gridFlow,
+        const cv::Mat& guide,
+        const FlowUpsampleParams& params)
+    {
+        CV_Assert(gridFlow.type() == CV_32FC2);
+        CV_Assert(!guide.empty());
+        CV_Assert(params.gridSpacing >= 1 && params.radius >= 1);
+
+        const int rows = guide.rows;
+        const int cols = guide.cols;
+        const int gs = params.gridSpacing;
+        const int s1 = gridFlow.cols;
+        const int s2 = gridFlow.rows;
+
+        // Grid flow is in grid cells; scale once to pixels.
+        cv::Mat gridPx;
+        gridFlow.convertTo(gridPx, CV_32FC2, static_cast<double>(gs));
+
+        cv::Mat gray = toGray8U(guide);
+
+        // Guide intensity at each grid node, as int so the vector path can
+        // gather it.
+        cv::Mat nodeGuide(s2, s1, CV_32S);
+        for (int i = 0; i < s2; ++i) {
+            const uchar* src = gray.ptr<uchar>(std::min(i * gs, rows - 1));
+            int* dst = nodeGuide.ptr<int>(i);
+            for (int j = 0; j < s1; ++j) {
+                dst[j] = src[std::min(j * gs, cols - 1)];
+            }
+        }
+
+        float rangeLUT[256];
+        const float sr = std::max(params.sigmaRange, 1e-3f);
+        for (int d = 0; d < 256; ++d) {
+            rangeLUT[d] = std::exp(-(d * d) / (2.0f * sr * sr));
+        }
+
+        const AxisTaps tx = buildAxisTaps(cols, s1, gs, params.radius);
+        const AxisTaps ty = buildAxisTaps(rows, s2, gs, params.radius);
+        const int K = tx.K;
+
+        cv::Mat flow(rows, cols, CV_32FC2);
+
+        cv::parallel_for_(cv::Range(0, rows), [&](const cv::Range& band) {
+            std::vector<const float*> flowRows(K);
+            std::vector<const int*> guideRows(K);
+
+            for (int y = band.start; y < band.end; ++y) {
+                const float* yw = &ty.weight[0];
+                for (int k = 0; k < K; ++k) {
+                    const int yn = ty.node[static_cast<size_t>(k) * rows + y];
+                    flowRows[k] = gridPx.ptr<float>(yn);
+                    guideRows[k] = nodeGuide.ptr<int>(yn);
+                }
+
+                const uchar* g = gray.ptr<uchar>(y);
+                float* out = flow.ptr<float>(y);
+                int x = 0;
+
+#if SLS_SIMD
+                // VL pixels at a time; every tap gathers its node's flow and
+                // guide value per lane.
+                const int VL = cv::VTraits<cv::v_float32>::vlanes();
+                const cv::v_float32 zero = cv::vx_setzero_f32();
+                const cv::v_float32 eps = cv::vx_setall_f32(1e-4f);
+                for (; x <= cols - VL; x += VL) {
+                    const cv::v_int32 c = cv::v_reinterpret_as_s32(cv::vx_load_expand_q(g + x));
+                    cv::v_float32 u = zero, v = zero, wSum = zero;
+                    cv::v_float32 uS = zero, vS = zero, wSumS = zero;
+
+                    for (int ky = 0; ky < K; ++ky) {
+                        const cv::v_float32 wy = cv::vx_setall_f32(yw[static_cast<size_t>(ky) * rows + y]);
+                        const float* fr = flowRows[ky];
+                        const int* gr = guideRows[ky];
+                        for (int kx = 0; kx < K; ++kx) {
+                            const size_t t = static_cast<size_t>(kx) * cols + x;
+                            const cv::v_int32 n = cv::vx_load(&tx.node[t]);
+                            const cv::v_float32 ws = cv::v_mul(wy, cv::vx_load(&tx.weight[t]));
+                            const cv::v_int32 d = cv::v_reinterpret_as_s32(cv::v_abs(cv::v_sub(c, cv::v_lut(gr, n))));
+                            const cv::v_float32 w = cv::v_mul(ws, cv::v_lut(rangeLUT, d));
+                            const cv::v_int32 n2 = cv::v_add(n, n);
+                            const cv::v_float32 fu = cv::v_lut(fr, n2);
+                            const cv::v_float32 fv = cv::v_lut(fr + 1, n2);
+                            u = cv::v_fma(w, fu, u);
+                            v = cv::v_fma(w, fv, v);
+                            wSum = cv::v_add(wSum, w);
+                            uS = cv::v_fma(ws, fu, uS);
+                            vS = cv::v_fma(ws, fv, vS);
+                            wSumS = cv::v_add(wSumS, ws);
+                        }
+                    }
+
+                    const cv::v_float32 useRange = cv::v_gt(wSum, cv::v_mul(eps, wSumS));
+                    const cv::v_float32 outU = cv::v_select(useRange, cv::v_div(u, wSum), cv::v_div(uS, wSumS));
+                    const cv::v_float32 outV = cv::v_select(useRange, cv::v_div(v, wSum), cv::v_div(vS, wSumS));
+                    cv::v_store_interleave(out + 2 * x, outU, outV);
+                }
+#endif
+                for (; x < cols; ++x) {
+                    const int c = g[x];
+
+                    float u = 0.0f, v = 0.0f, wSum = 0.0f;
+                    float uS = 0.0f, vS = 0.0f, wSumS = 0.0f;
+
+                    for (int ky = 0; ky < K; ++ky) {
+                        const float wy = yw[static_cast<size_t>(ky) * rows + y];
+                        const float* fr = flowRows[ky];
+                        const int* gr = guideRows[ky];
+                        for (int kx = 0; kx < K; ++kx) {
+                            const size_t t = static_cast<size_t>(kx) * cols + x;
+                            const int n = tx.node[t];
+                            const float ws = wy * tx.weight[t];
+                            const float w = ws * rangeLUT[std::abs(c - gr[n])];
+                            const float fu = fr[2 * n];
+                            const float fv = fr[2 * n + 1];
+                            u += w * fu;  v += w * fv;  wSum += w;
+                            uS += ws * fu; vS += ws * fv; wSumS += ws;
+                        }
+                    }
+
+                    // Fall back to the purely spatial estimate when no node is
+                    // photometrically similar (thin structures between nodes).
+                    if (wSum > 1e-4f * wSumS) {
+                        out[2 * x] = u / wSum;
+                        out[2 * x + 1] = v / wSum;
+                    }
+                    else {
+                        out[2 * x] = uS / wSumS;
+                        out[2 * x + 1] = vS / wSumS;
+                    }
+                }
+            }
+        });
+
+        return flow;
+    }
+}
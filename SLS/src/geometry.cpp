@@ -0,0 +1,388 @@
+#include "sls/geometry.hpp"
+#include <opencv2/opencv.hpp>
+#include "sls/simd.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <numeric>
+#include <vector>
+
+namespace sls {
+
+    namespace {
+
+        // Correspondences in structure-of-arrays form, sorted best-first.
+        struct PointSoA {
+            std::vector<float> xs, ys, xd, yd;
+            int size() const { return static_cast<int>(xs.size()); }
+        };
+
+        struct Hypothesis {
+            int  t;        // hypothesis index, also seeds the sampler
+            int  n;        // PROSAC subset size
+        };
+
+        int sampleSizeFor(GeometryModel model)
+        {
+            switch (model) {
+            case GeometryModel::Homography: return 4;
+            case GeometryModel::Affine:     return 3;
+            default:                        return 2;
+            }
+        }
+
+        bool collinear(const cv::Point2f& a, const cv::Point2f& b, const cv::Point2f& c)
+        {
+            float cross = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+            return std::abs(cross) < 1e-3f;
+        }
+
+        bool degenerate(const std::vector<cv::Point2f>& p)
+        {
+            const int m = static_cast<int>(p.size());
+            if (m == 2) {
+                return cv::norm(p[0] - p[1]) < 1e-3;
+            }
+            for (int i = 0; i < m; ++i)
+                for (int j = i + 1; j < m; ++j)
+                    for (int k = j + 1; k < m; ++k)
+                        if (collinear(p[i], p[j], p[k])) return true;
+            return false;
+        }
+
+        // Minimal solver. Returns an empty Mat on degenerate samples.
+        cv::Mat fitMinimal(const std::vector<cv::Point2f>& s,
+            const std::vector<cv::Point2f>& d,
+            GeometryModel model)
+        {
+            if (degenerate(s) || degenerate(d)) return cv::Mat();
+
+            cv::Mat H = cv::Mat::eye(3, 3, CV_64F);
+            if (model == GeometryModel::Homography) {
+                H = cv::getPerspectiveTransform(s.data(), d.data());
+            }
+            else if (model == GeometryModel::Affine) {
+                cv::Mat A = cv::getAffineTransform(s.data(), d.data());
+                A.copyTo(H.rowRange(0, 2));
+            }
+            else {
+                // d = a * s + b in complex form, a = (d1 - d0) / (s1 - s0).
+                double sx = s[1].x - s[0].x, sy = s[1].y - s[0].y;
+                double dx = d[1].x - d[0].x, dy = d[1].y - d[0].y;
+                double den = sx * sx + sy * sy;
+                double a = (dx * sx + dy * sy) / den;
+                double b = (dy * sx - dx * sy) / den;
+                H.at<double>(0, 0) = a;  H.at<double>(0, 1) = -b;
+                H.at<double>(1, 0) = b;  H.at<double>(1, 1) = a;
+                H.at<double>(0, 2) = d[0].x - (a * s[0].x - b * s[0].y);
+                H.at<double>(1, 2) = d[0].y - (b * s[0].x + a * s[0].y);
+            }
+
+            if (H.empty() || !cv::checkRange(H)) return cv::Mat();
+            return H;
+        }
+
+        // Count correspondences whose reprojection error is below sqrt(thr2).
+        // Gives up (returning -1) once the remaining points cannot lift the
+        // count to `mustBeat`.
+        int countInliers(const PointSoA& P, const cv::Mat& Hm, float thr2, int mustBeat)
+        {
+            const double* Hd = Hm.ptr<double>();
+            float h[9];
+            for (int k = 0; k < 9; ++k) h[k] = static_cast<float>(Hd[k]);
+
+            const int N = P.size();
+            const int chunk = 1024;
+            int count = 0;
+
+            for (int start = 0; start < N; start += chunk) {
+                const int end = std::min(N, start + chunk);
+                int i = start;
+#if SLS_SIMD
+                const int VL = cv::VTraits<cv::v_float32>::vlanes();
+                const cv::v_float32 h0 = cv::vx_setall_f32(h[0]), h1 = cv::vx_setall_f32(h[1]),
+                    h2 = cv::vx_setall_f32(h[2]), h3 = cv::vx_setall_f32(h[3]),
+                    h4 = cv::vx_setall_f32(h[4]), h5 = cv::vx_setall_f32(h[5]),
+                    h6 = cv::vx_setall_f32(h[6]), h7 = cv::vx_setall_f32(h[7]),
+                    h8 = cv::vx_setall_f32(h[8]);
+                const cv::v_float32 one = cv::vx_setall_f32(1.0f);
+                const cv::v_float32 zero = cv::vx_setzero_f32();
+                const cv::v_float32 thr = cv::vx_setall_f32(thr2);
+                cv::v_float32 acc = cv::vx_setzero_f32();
+
+                for (; i <= end - VL; i += VL) {
+                    cv::v_float32 x = cv::vx_load(&P.xs[i]);
+                    cv::v_float32 y = cv::vx_load(&P.ys[i]);
+                    cv::v_float32 iw = cv::v_div(one, cv::v_fma(h6, x, cv::v_fma(h7, y, h8)));
+                    cv::v_float32 u = cv::v_mul(cv::v_fma(h0, x, cv::v_fma(h1, y, h2)), iw);
+                    cv::v_float32 v = cv::v_mul(cv::v_fma(h3, x, cv::v_fma(h4, y, h5)), iw);
+                    cv::v_float32 du = cv::v_sub(u, cv::vx_load(&P.xd[i]));
+                    cv::v_float32 dv = cv::v_sub(v, cv::vx_load(&P.yd[i]));
+                    cv::v_float32 e2 = cv::v_fma(du, du, cv::v_mul(dv, dv));
+                    acc = cv::v_add(acc, cv::v_select(cv::v_lt(e2, thr), one, zero));
+                }
+                count += cvRound(cv::v_reduce_sum(acc));
+#endif
+                for (; i < end; ++i) {
+                    float x = P.xs[i], y = P.ys[i];
+                    float iw = 1.0f / (h[6] * x + h[7] * y + h[8]);
+                    float du = (h[0] * x + h[1] * y + h[2]) * iw - P.xd[i];
+                    float dv = (h[3] * x + h[4] * y + h[5]) * iw - P.yd[i];
+                    if (du * du + dv * dv < thr2) ++count;
+                }
+
+                if (count + (N - end) < mustBeat) return -1;
+            }
+            return count;
+        }
+
+        int inlierMask(const PointSoA& P, const cv::Mat& Hm, float thr2, std::vector<uchar>& mask)
+        {
+            const cv::Matx33d H(Hm.ptr<double>());
+            const int N = P.size();
+            mask.assign(N, 0);
+            int count = 0;
+            for (int i = 0; i < N; ++i) {
+                cv::Vec3d q = H * cv::Vec3d(P.xs[i], P.ys[i], 1.0);
+                double du = q[0] / q[2] - P.xd[i];
+                double dv = q[1] / q[2] - P.yd[i];
+                if (du * du + dv * dv < thr2) {
+                    mask[i] = 1;
+                    ++count;
+                }
+            }
+            return count;
+        }
+
+        // Least-squares refit on all inliers.
+        cv::Mat refit(const PointSoA& P, const std::vector<uchar>& mask, GeometryModel model)
+        {
+            std::vector<cv::Point2f> s, d;
+            for (int i = 0; i < P.size(); ++i) {
+                if (!mask[i]) continue;
+                s.emplace_back(P.xs[i], P.ys[i]);
+                d.emplace_back(P.xd[i], P.yd[i]);
+            }
+            const int n = static_cast<int>(s.size());
+
+            if (model == GeometryModel::Homography) {
+                if (n < 4) return cv::Mat();
+                return cv::findHomography(s, d, 0);
+            }
+
+            const int k = (model == GeometryModel::Affine) ? 6 : 4;
+            if (2 * n < k) return cv::Mat();
+
+            cv::Mat A = cv::Mat::zeros(2 * n, k, CV_64F);
+            cv::Mat b(2 * n, 1, CV_64F);
+            for (int i = 0; i < n; ++i) {
+                double* r0 = A.ptr<double>(2 * i);
+                double* r1 = A.ptr<double>(2 * i + 1);
+                if (k == 6) {
+                    r0[0] = s[i].x; r0[1] = s[i].y; r0[2] = 1.0;
+                    r1[3] = s[i].x; r1[4] = s[i].y; r1[5] = 1.0;
+                }
+                else {
+                    r0[0] = s[i].x; r0[1] = -s[i].y; r0[2] = 1.0;
+                    r1[0] = s[i].y; r1[1] = s[i].x;  r1[3] = 1.0;
+                }
+                b.at<double>(2 * i) = d[i].x;
+                b.at<double>(2 * i + 1) = d[i].y;
+            }
+
+            cv::Mat x;
+            if (!cv::solve(A, b, x, cv::DECOMP_SVD)) return cv::Mat();
+            const double* p = x.ptr<double>();
+
+            cv::Mat H = cv::Mat::eye(3, 3, CV_64F);
+            if (k == 6) {
+                for (int j = 0; j < 6; ++j) H.at<double>(j / 3, j % 3) = p[j];
+            }
+            else {
+                H.at<double>(0, 0) = p[0]; H.at<double>(0, 1) = -p[1]; H.at<double>(0, 2) = p[2];
+                H.at<double>(1, 0) = p[1]; H.at<double>(1, 1) = p[0];  H.at<double>(1, 2) = p[3];
+            }
+            return H;
+        }
+    }
+
+    GeometryResult estimateGeometry(const std::vector<cv::Point2f>& src,
+        const std::vector<cv::Point2f>& dst,
+        const std::vector<float>& quality,
+        GeometryModel model,
+        const RansacParams& params)
+    {
+        CV_Assert(src.size() == dst.size());
+        CV_Assert(quality.empty() || quality.size() == src.size());
+
+        GeometryResult res;
+        res.numInliers = 0;
+        res.iterations = 0;
+        res.success = false;
+
+        const int N = static_cast<int>(src.size());
+        const int m = sampleSizeFor(model);
+        res.inlierMask.assign(N, 0);
+        if (N < m) return res;
+
+        // Rank correspondences best-first so PROSAC can grow from the top.
+        std::vector<int> order(N);
+        std::iota(order.begin(), order.end(), 0);
+        const bool progressive = !quality.empty();
+        if (progressive) {
+            std::stable_sort(order.begin(), order.end(),
+                [&](int a, int b) { return quality[a] < quality[b]; });
+        }
+
+        PointSoA P;
+        P.xs.resize(N); P.ys.resize(N); P.xd.resize(N); P.yd.resize(N);
+        for (int i = 0; i < N; ++i) {
+            P.xs[i] = src[order[i]].x;  P.ys[i] = src[order[i]].y;
+            P.xd[i] = dst[order[i]].x;  P.yd[i] = dst[order[i]].y;
+        }
+
+        const float thr2 = static_cast<float>(params.reprojThreshold * params.reprojThreshold);
+        const int batchSize = std::max(1, params.batchSize);
+
+        // PROSAC growth schedule (Chum & Matas): subset size n increases
+        // whenever the hypothesis counter passes T'_n.
+        int n = progressive ? m : N;
+        double Tn = params.maxIterations;
+        for (int i = 0; i < m; ++i) {
+            Tn *= static_cast<double>(n - i) / (N - i);
+        }
+        double TnPrime = 1.0;
+
+        std::atomic<int> bestCount(-1);
+        int bestT = -1;
+        cv::Mat bestModel;
+        std::mutex bestMutex;
+
+        int t = 0;
+        double kMax = params.maxIterations;
+
+        while (t < kMax) {
+            std::vector<Hypothesis> batch;
+            batch.reserve(batchSize);
+            for (int b = 0; b < batchSize && t < kMax; ++b, ++t) {
+                while (n < N && t + 1 >= TnPrime) {
+                    double Tn1 = Tn * (n + 1) / (n + 1 - m);
+                    TnPrime += std::ceil(Tn1 - Tn);
+                    Tn = Tn1;
+                    ++n;
+                }
+                batch.push_back({ t, n });
+            }
+
+            cv::parallel_for_(cv::Range(0, static_cast<int>(batch.size())), [&](const cv::Range& r) {
+                std::vector<int> idx(m);
+                std::vector<cv::Point2f> s(m), d(m);
+                for (int bi = r.start; bi < r.end; ++bi) {
+                    const Hypothesis& hyp = batch[bi];
+                    cv::RNG rng(static_cast<uint64_t>(params.seed) * 0x9E3779B97F4A7C15ULL
+                        + static_cast<uint64_t>(hyp.t) + 1);
+
+                    // With a growing subset, the newest point is always in
+                    // the sample and the rest come from the points above it.
+                    int fixed = 0;
+                    int pool = hyp.n;
+                    if (hyp.n < N) {
+                        idx[0] = hyp.n - 1;
+                        fixed = 1;
+                        pool = hyp.n - 1;
+                    }
+                    for (int k = fixed; k < m; ++k) {
+                        int cand;
+                        bool dup;
+                        do {
+                            cand = rng.uniform(0, pool);
+                            dup = std::find(idx.begin(), idx.begin() + k, cand) != idx.begin() + k;
+                        } while (dup);
+                        idx[k] = cand;
+                    }
+                    for (int k = 0; k < m; ++k) {
+                        s[k] = cv::Point2f(P.xs[idx[k]], P.ys[idx[k]]);
+                        d[k] = cv::Point2f(P.xd[idx[k]], P.yd[idx[k]]);
+                    }
+
+                    cv::Mat H = fitMinimal(s, d, model);
+                    if (H.empty()) continue;
+
+                    int c = countInliers(P, H, thr2, bestCount.load());
+                    if (c < 0) continue;
+
+                    std::lock_guard<std::mutex> lock(bestMutex);
+                    int cur = bestCount.load();
+                    if (c > cur || (c == cur && hyp.t < bestT)) {
+                        bestCount.store(c);
+                        bestT = hyp.t;
+                        bestModel = H;
+                    }
+                }
+            });
+
+            // Adaptive termination from the current inlier ratio.
+            const int best = bestCount.load();
+            if (best > 0) {
+                double w = static_cast<double>(best) / N;
+                double pAllIn = std::pow(w, m);
+                if (pAllIn >= 1.0 - 1e-12) {
+                    kMax = std::min<double>(kMax, t);
+                }
+                else if (pAllIn > 0.0) {
+                    double k = std::log(1.0 - params.confidence) / std::log(1.0 - pAllIn);
+                    kMax = std::min<double>(kMax, std::ceil(k));
+                }
+            }
+        }
+
+        res.iterations = t;
+        if (bestModel.empty()) return res;
+
+        // Local optimisation: refit on inliers while it does not lose support.
+        std::vector<uchar> mask;
+        int count = inlierMask(P, bestModel, thr2, mask);
+        for (int it = 0; it < 2; ++it) {
+            cv::Mat H = refit(P, mask, model);
+            if (H.empty() || !cv::checkRange(H)) break;
+            std::vector<uchar> mask2;
+            int count2 = inlierMask(P, H, thr2, mask2);
+            if (count2 < count) break;
+            bestModel = H;
+            mask.swap(mask2);
+            count = count2;
+        }
+
+        double h22 = bestModel.at<double>(2, 2);
+        if (std::abs(h22) > 1e-12) bestModel /= h22;
+
+        res.model = bestModel;
+        res.numInliers = count;
+        res.success = true;
+        for (int i = 0; i < N; ++i) {
+            res.inlierMask[order[i]] = mask[i];
+        }
+        return res;
+    }
+
+    void matchesToCorrespondences(const std::vector<cv::DMatch>& matches,
+        const std::vector<cv::KeyPoint>& kp1,
+        const std::vector<cv::KeyPoint>& kp2,
+        std::vector<cv::Point2f>& src,
+        std::vector<cv::Point2f>& dst,
+        std::vector<float>& quality)
+    {
+        src.clear(); dst.clear(); quality.clear();
+        src.reserve(matches.size());
+        dst.reserve(matches.size());
+        quality.reserve(matches.size());
+
+        for (const auto& m : matches) {
+            src.push_back(kp1[m.queryIdx].pt);
+            dst.push_back(kp2[m.trainIdx].pt);
+            quality.push_back(m.distance);
+        }
+    }
+}
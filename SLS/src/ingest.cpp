@@ -0,0 +1,68 @@
+#include "sls/ingest.hpp"
+#include <opencv2/opencv.hpp>
+#include <cmath>
+#include <fstream>
+
+namespace sls {
+
+    namespace {
+
+        // JPEG streams start with an SOI marker followed by another marker.
+        bool isJpeg(const uchar* head, size_t size)
+        {
+            return size >= 3 && head[0] == 0xFF && head[1] == 0xD8 && head[2] == 0xFF;
+        }
+
+        bool isJpegFile(const std::string& path)
+        {
+            uchar head[3] = { 0, 0, 0 };
+            std::ifstream f(path, std::ios::binary);
+            f.read(reinterpret_cast<char*>(head), sizeof(head));
+            return isJpeg(head, static_cast<size_t>(f.gcount()));
+        }
+
+        // Largest decoder reduction (1, 2, 4 or 8) that does not go below the
+        // requested scale, together with its imread flag. Only JPEG reduces
+        // in the decoder by filtering (DCT scaling).
+        int reducedDecodeFlag(double scaleFactor, bool jpeg, int& reduction)
+        {
+            const double eps = 1e-9;
+            if (!jpeg) { reduction = 1; return cv::IMREAD_GRAYSCALE; }
+            if (scaleFactor <= 0.125 + eps) { reduction = 8; return cv::IMREAD_REDUCED_GRAYSCALE_8; }
+            if (scaleFactor <= 0.25 + eps)  { reduction = 4; return cv::IMREAD_REDUCED_GRAYSCALE_4; }
+            if (scaleFactor <= 0.5 + eps)   { reduction = 2; return cv::IMREAD_REDUCED_GRAYSCALE_2; }
+            reduction = 1;
+            return cv::IMREAD_GRAYSCALE;
+        }
+
+        cv::Mat finishScale(const cv::Mat& decoded, double scaleFactor, int reduction)
+        {
+            if (decoded.empty()) return decoded;
+
+            const double remaining = scaleFactor * reduction;
+            if (std::abs(remaining - 1.0) < 1e-9) {
+                return decoded;
+            }
+
+            cv::Mat out;
+            cv::resize(decoded, out, cv::Size(), remaining, remaining,
+                remaining < 1.0 ? cv::INTER_AREA : cv::INTER_LINEAR);
+            return out;
+        }
+    }
+
+    cv::Mat loadGrayscale(const std::string& path, double scaleFactor)
+    {
+        int reduction = 1;
+        int flag = reducedDecodeFlag(scaleFactor, isJpegFile(path), reduction);
+        return finishScale(cv::imread(path, flag), scaleFactor, reduction);
+    }
+
+    cv::Mat decodeGrayscale(const std::vector<uchar>& buffer, double scaleFactor)
+    {
+        int reduction = 1;
+        const bool jpeg = isJpeg(buffer.data(), buffer.size());
+        int flag = reducedDecodeFlag(scaleFactor, jpeg, reduction);
+        return finishScale(cv::imdecode(buffer, flag), scaleFactor, reduction);
+    }
+}
@@ -9,40 +9,14 @@
 #include "sls/sls_options.hpp"
 #include "sls/sls_extractor.hpp"
 #include "sls/dense_sift.hpp"
+#include "sls/geometry.hpp"
+#include "sls/ingest.hpp"
+#include "sls/matcher.hpp"
 
 using namespace cv;
 using std::cout;
 using std::endl;
 
-// Average descriptors across scales for each grid point
-// dp: D x (numPoints * numSigma), column layout = s + i * numSigma
-// Returns: D x numPoints
-static Mat averageAcrossScales(const Mat& dp,
-    int numPoints,
-    int numSigma)
-{
-    CV_Assert(dp.cols == numPoints * numSigma);
-    const int D = dp.rows;
-
-    Mat desc(D, numPoints, CV_32F);
-    desc.setTo(0);
-
-    float invNumSigma = 1.0f / static_cast<float>(numSigma);
-
-    for (int i = 0; i < numPoints; ++i) {
-        Mat outCol = desc.col(i);
-        outCol.setTo(0);
-
-        for (int s = 0; s < numSigma; ++s) {
-            int colIdx = s + i * numSigma;
-            outCol += dp.col(colIdx);
-        }
-        outCol *= invNumSigma;
-    }
-
-    return desc;
-}
-
 // build a uniform grid of keypoints given grid size (s1 x s2)
 // and image size (cols x rows).
 static void buildGridKeypoints(int gridWidth,
@@ -98,6 +72,34 @@ static void summarizeMatches(const std::vector<DMatch>& matches,
         << ", count = " << matches.size() << "\n";
 }
 
+// fit a homography to the matches and report inlier support
+static void reportGeometry(const std::vector<DMatch>& matches,
+    const std::vector<KeyPoint>& kp1,
+    const std::vector<KeyPoint>& kp2,
+    const std::string& name)
+{
+    std::vector<Point2f> src, dst;
+    std::vector<float> quality;
+    sls::matchesToCorrespondences(matches, kp1, kp2, src, dst, quality);
+
+    TickMeter tm;
+    tm.start();
+    sls::GeometryResult geo = sls::estimateGeometry(src, dst, quality,
+        sls::GeometryModel::Homography);
+    tm.stop();
+
+    if (!geo.success) {
+        cout << name << " homography: estimation failed.\n";
+        return;
+    }
+
+    cout << name << " homography:\n";
+    cout << "  inliers = " << geo.numInliers << " / " << matches.size()
+        << ", hypotheses = " << geo.iterations
+        << ", time = " << tm.getTimeMilli() << " ms\n";
+    cout << "  H = " << geo.model << "\n";
+}
+
 
 int main(int argc, char** argv)
 {
@@ -105,9 +107,11 @@ int main(int argc, char** argv)
     std::string srcPath = (argc > 1) ? argv[1] : "data/source.jpg";
     std::string tgtPath = (argc > 2) ? argv[2] : "data/target.jpg";
 
-    // Load images and make grayscale
-    Mat img1 = imread(srcPath, IMREAD_GRAYSCALE);
-    Mat img2 = imread(tgtPath, IMREAD_GRAYSCALE);
+    // Downsample for speed. Can change if needed.
+    // JPEGs are decoded directly at the reduced size and stay 8-bit grayscale.
+    double scaleFactor = 0.25;
+    Mat img1 = sls::loadGrayscale(srcPath, scaleFactor);
+    Mat img2 = sls::loadGrayscale(tgtPath, scaleFactor);
 
     if (img1.empty() || img2.empty()) {
         std::cerr << "ERROR: could not load source or target image.\n";
@@ -116,45 +120,24 @@ int main(int argc, char** argv)
         return -1;
     }
 
-    cout << "Loaded images:\n";
+    cout << "Loaded images (scale " << scaleFactor << "):\n";
     cout << "  source: " << srcPath << "  (" << img1.cols << " x " << img1.rows << ")\n";
     cout << "  target: " << tgtPath << "  (" << img2.cols << " x " << img2.rows << ")\n";
 
-    // Downsample for speed. Can change if needed
-    double scaleFactor = 0.25;
-    if (scaleFactor != 1.0) {
-        resize(img1, img1, Size(), scaleFactor, scaleFactor, INTER_AREA);
-        resize(img2, img2, Size(), scaleFactor, scaleFactor, INTER_AREA);
-        cout << "After downsampling: "
-            << img1.cols << " x " << img1.rows << endl;
-    }
-
 
     // Compute dense SIFT (DSIFT) baseline (multi-scale descriptors)
-    SLSOptions opts;
-
-    opts.sigma.clear();
-    int numSigma = 3;
-    float sigmaStart = 1.0f;
-    float sigmaEnd = 4.0f;
-    float step = (sigmaEnd - sigmaStart) / (numSigma - 1);
-
-    for (int i = 0; i < numSigma; ++i) {
-        float s = sigmaStart + i * step;
-        opts.sigma.push_back(s);
-    }
-
-    opts.gridSpacing = 8;
-    opts.dimReduction = 32;
-    opts.dimReductionCov = 20000;
-    opts.subsDim = 6;
+    SLSOptions opts = makeSLSOptions(false);
+    int numSigma = static_cast<int>(opts.sigma.size());
 
     TickMeter tm;
 
     cout << "\n[INFO] Computing DSIFT descriptors...\n";
     tm.start();
-    DescriptorGrid ds1 = generateDescriptors(img1, opts);
-    DescriptorGrid ds2 = generateDescriptors(img2, opts);
+    Ptr<SIFT> sift = SIFT::create();
+    PaddedImage pad1 = padForDescriptors(img1, opts);
+    PaddedImage pad2 = padForDescriptors(img2, opts);
+    DescriptorGrid ds1 = generateDescriptors(pad1, opts, sift);
+    DescriptorGrid ds2 = generateDescriptors(pad2, opts, sift);
     tm.stop();
     cout << "[INFO] DSIFT done.\n";
 
@@ -173,7 +156,14 @@ int main(int argc, char** argv)
     cout << "\nComputing SLS descriptors...\n";
     tm.reset();
     tm.start();
-    SLSOutput slsOut = extractScalelessDescs(img1, img2, usePaperParams);
+    SLSOutput slsOut;
+    if (!usePaperParams) {
+        // Same options as the DSIFT baseline: reuse its multi-scale grids.
+        slsOut = extractScalelessDescs(ds1, ds2, opts);
+    }
+    else {
+        slsOut = extractScalelessDescs(img1, img2, usePaperParams);
+    }
     tm.stop();
     cout << "SLS done.\n";
 
@@ -193,9 +183,6 @@ int main(int argc, char** argv)
     Mat dsift1 = averageAcrossScales(ds1.dpMat, ds1.numPoints, numSigma);
     Mat dsift2 = averageAcrossScales(ds2.dpMat, ds2.numPoints, numSigma);
 
-    Mat dsift1T = dsift1.t();
-    Mat dsift2T = dsift2.t();
-
     // Build keypoints on a uniform grid (for both DSIFT and SLS)
     std::vector<KeyPoint> kp1, kp2;
     buildGridKeypoints(ds1.s1, ds1.s2, img1.cols, img1.rows, kp1);
@@ -205,20 +192,19 @@ int main(int argc, char** argv)
         std::cerr << "WARNING: keypoint count and numPoints differ.\n";
     }
 
-    // Match DSIFT descriptors using BFMatcher (L2)
+    // Match DSIFT descriptors (exact L2, mutual nearest neighbours)
     cout << "\n[INFO] Matching DSIFT descriptors...\n";
     tm.reset();
     tm.start();
 
-    BFMatcher matcherDSIFT(NORM_L2, true);
-    std::vector<DMatch> matchesDSIFT;
-    matcherDSIFT.match(dsift1T, dsift2T, matchesDSIFT);
+    std::vector<DMatch> matchesDSIFT = sls::matchDescriptors(dsift1, dsift2);
 
     tm.stop();
     cout << "  DSIFT matches found: " << matchesDSIFT.size() << "\n";
     cout << "  DSIFT matching time: " << tm.getTimeMilli() << " ms\n";
 
     summarizeMatches(matchesDSIFT, "DSIFT");
+    reportGeometry(matchesDSIFT, kp1, kp2, "DSIFT");
 
     // Sort matches by distance and keep best K
     std::sort(matchesDSIFT.begin(), matchesDSIFT.end(),
@@ -253,15 +239,10 @@ int main(int argc, char** argv)
     }
     else {
         cout << "\n[INFO] Matching SLS descriptors...\n";
-        Mat sls1T = slsOut.desc1.t();
-        Mat sls2T = slsOut.desc2.t();
-
         tm.reset();
         tm.start();
 
-        BFMatcher matcherSLS(NORM_L2, true);
-        std::vector<DMatch> matchesSLS;
-        matcherSLS.match(sls1T, sls2T, matchesSLS);
+        std::vector<DMatch> matchesSLS = sls::matchDescriptors(slsOut.desc1, slsOut.desc2);
 
         tm.stop();
         cout << "  SLS matches found: " << matchesSLS.size() << "\n";
@@ -269,6 +250,7 @@ int main(int argc, char** argv)
 
         // Summarize SLS match quality before trimming
         summarizeMatches(matchesSLS, "SLS");
+        reportGeometry(matchesSLS, kp1, kp2, "SLS");
 
         std::sort(matchesSLS.begin(), matchesSLS.end(),
             [](const DMatch& a, const DMatch& b) {
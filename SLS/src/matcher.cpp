@@ -0,0 +1,316 @@
+#include "sls/matcher.hpp"
+#include <opencv2/opencv.hpp>
+#include <opencv2/core/hal/hal.hpp>
+#include "sls/simd.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace sls {
+
+    namespace {
+
+        // D x N descriptors -> continuous N x D float rows.
+        cv::Mat toRowMajor(const cv::Mat& desc)
+        {
+            cv::Mat rows;
+            desc.t().convertTo(rows, CV_32F);
+            return rows;
+        }
+
+        // Insert (d, j) into an ascending top-k list. The caller has checked
+        // d < dist[k - 1]; equal distances keep the entry seen first.
+        inline void insertTopK(float* dist, int* idx, int k, float d, int j)
+        {
+            int pos = k - 1;
+            while (pos > 0 && d < dist[pos - 1]) {
+                dist[pos] = dist[pos - 1];
+                idx[pos] = idx[pos - 1];
+                --pos;
+            }
+            dist[pos] = d;
+            idx[pos] = j;
+        }
+
+        // Total order used when merging lists from different row bands:
+        // distance first, then the lower index; padding (-1) sorts last.
+        inline bool precedes(float da, int ia, float db, int ib)
+        {
+            if (ia < 0) return false;
+            if (ib < 0) return true;
+            return da < db || (da == db && ia < ib);
+        }
+
+        void mergeTopK(float* dist, int* idx, int k, float d, int j)
+        {
+            if (!precedes(d, j, dist[k - 1], idx[k - 1])) return;
+            int pos = k - 1;
+            while (pos > 0 && precedes(d, j, dist[pos - 1], idx[pos - 1])) {
+                dist[pos] = dist[pos - 1];
+                idx[pos] = idx[pos - 1];
+                --pos;
+            }
+            dist[pos] = d;
+            idx[pos] = j;
+        }
+
+        void initTable(NeighbourTable& table, int n, int k)
+        {
+            table.indices.create(n, k, CV_32S);
+            table.indices.setTo(-1);
+            table.distances.create(n, k, CV_32F);
+            table.distances.setTo(FLT_MAX);
+        }
+
+        // Squared distances -> distances, leaving the padding untouched.
+        void finishTable(NeighbourTable& table)
+        {
+            cv::parallel_for_(cv::Range(0, table.distances.rows), [&](const cv::Range& r) {
+                for (int i = r.start; i < r.end; ++i) {
+                    float* d = table.distances.ptr<float>(i);
+                    const int* j = table.indices.ptr<int>(i);
+                    for (int l = 0; l < table.distances.cols; ++l) {
+                        if (j[l] >= 0) d[l] = std::sqrt(d[l]);
+                    }
+                }
+            });
+        }
+
+        // Private backward lists (distance, index) plus the column k-th best
+        // of one row band.
+        size_t bandScratchBytes(long long N2, int k)
+        {
+            return static_cast<size_t>(N2) * (k * (sizeof(float) + sizeof(int)) + sizeof(float));
+        }
+
+        // One band per worker thread, fewer when their backward lists would
+        // exceed params.scratchMB (at least one band always runs).
+        int knnBandCount(long long N1, long long N2, int k, const MatcherParams& params, int threads)
+        {
+            const long long numRowBlocks = (N1 + params.blockRows - 1) / params.blockRows;
+            const size_t perBand = std::max<size_t>(1, bandScratchBytes(N2, k));
+            const size_t budget = static_cast<size_t>(std::max(0, params.scratchMB)) << 20;
+            const long long affordable = std::max<long long>(1, static_cast<long long>(budget / perBand));
+            return static_cast<int>(std::max<long long>(1,
+                std::min(numRowBlocks, std::min<long long>(std::max(1, threads), affordable))));
+        }
+
+        void knnRowMajor(const cv::Mat& A,
+            const cv::Mat& B,
+            NeighbourTable& forward,
+            NeighbourTable& backward,
+            const MatcherParams& params)
+        {
+            const int k = params.k;
+            const int N1 = A.rows, N2 = B.rows;
+            const int blockRows = params.blockRows, blockCols = params.blockCols;
+
+            initTable(forward, N1, k);
+            initTable(backward, N2, k);
+            if (N1 == 0 || N2 == 0) return;
+
+            cv::Mat sq, normA, normB;
+            cv::multiply(A, A, sq);
+            cv::reduce(sq, normA, 1, cv::REDUCE_SUM, CV_32F);
+            cv::multiply(B, B, sq);
+            cv::reduce(sq, normB, 1, cv::REDUCE_SUM, CV_32F);
+            const float* nA = normA.ptr<float>();
+            const float* nB = normB.ptr<float>();
+
+            // Rows are split into bands of whole row blocks. Forward lists are
+            // owned by a single band; each band keeps private backward lists so
+            // column updates need no locking, and they are merged at the end.
+            // Those lists cost N2 * k entries per band, so there is one band
+            // per thread at most (see knnBandCount).
+            const int numRowBlocks = (N1 + blockRows - 1) / blockRows;
+            const int numBands = knnBandCount(N1, N2, k, params, cv::getNumThreads());
+            std::vector<std::vector<float> > bandDist(numBands);
+            std::vector<std::vector<int> > bandIdx(numBands);
+
+            cv::parallel_for_(cv::Range(0, numBands), [&](const cv::Range& r) {
+                cv::Mat G;
+                std::vector<float> colWorst;
+                for (int b = r.start; b < r.end; ++b) {
+                    std::vector<float>& cd = bandDist[b];
+                    std::vector<int>& ci = bandIdx[b];
+                    cd.assign(static_cast<size_t>(N2) * k, FLT_MAX);
+                    ci.assign(static_cast<size_t>(N2) * k, -1);
+                    // k-th best of every column, contiguous for the SIMD filter.
+                    colWorst.assign(N2, FLT_MAX);
+
+                    const int blkBegin = static_cast<int>(static_cast<long long>(numRowBlocks) * b / numBands);
+                    const int blkEnd = static_cast<int>(static_cast<long long>(numRowBlocks) * (b + 1) / numBands);
+
+                    for (int rb = blkBegin; rb < blkEnd; ++rb) {
+                        const int r0 = rb * blockRows;
+                        const int r1 = std::min(N1, r0 + blockRows);
+                        const cv::Mat Ablk = A.rowRange(r0, r1);
+
+                        for (int c0 = 0; c0 < N2; c0 += blockCols) {
+                            const int c1 = std::min(N2, c0 + blockCols);
+                            // G = -2 A_blk B_blk^T
+                            cv::gemm(Ablk, B.rowRange(c0, c1), -2.0, cv::noArray(), 0.0, G, cv::GEMM_2_T);
+
+                            for (int i = r0; i < r1; ++i) {
+                                const float* g = G.ptr<float>(i - r0) - c0;
+                                float* rd = forward.distances.ptr<float>(i);
+                                int* ri = forward.indices.ptr<int>(i);
+                                const float ni = nA[i];
+
+                                auto update = [&](int j, float d) {
+                                    if (d < rd[k - 1]) {
+                                        insertTopK(rd, ri, k, d, j);
+                                    }
+                                    if (d < colWorst[j]) {
+                                        float* dj = &cd[static_cast<size_t>(j) * k];
+                                        insertTopK(dj, &ci[static_cast<size_t>(j) * k], k, d, i);
+                                        colWorst[j] = dj[k - 1];
+                                    }
+                                };
+
+                                int j = c0;
+#if SLS_SIMD
+                                const int VL = cv::VTraits<cv::v_float32>::vlanes();
+                                const cv::v_float32 vni = cv::vx_setall_f32(ni);
+                                const cv::v_float32 zero = cv::vx_setzero_f32();
+                                float lane[cv::VTraits<cv::v_float32>::max_nlanes];
+                                for (; j <= c1 - VL; j += VL) {
+                                    cv::v_float32 d = cv::v_max(zero,
+                                        cv::v_add(cv::vx_load(g + j), cv::v_add(vni, cv::vx_load(nB + j))));
+                                    // Most candidates beat neither the row's nor
+                                    // the column's current k-th best.
+                                    cv::v_float32 hit = cv::v_or(
+                                        cv::v_lt(d, cv::vx_setall_f32(rd[k - 1])),
+                                        cv::v_lt(d, cv::vx_load(&colWorst[j])));
+                                    if (!cv::v_check_any(hit)) continue;
+                                    cv::v_store(lane, d);
+                                    for (int l = 0; l < VL; ++l) update(j + l, lane[l]);
+                                }
+#endif
+                                for (; j < c1; ++j) {
+                                    update(j, std::max(0.0f, g[j] + ni + nB[j]));
+                                }
+                            }
+                        }
+                    }
+                }
+            });
+
+            cv::parallel_for_(cv::Range(0, N2), [&](const cv::Range& r) {
+                for (int j = r.start; j < r.end; ++j) {
+                    float* dj = backward.distances.ptr<float>(j);
+                    int* ij = backward.indices.ptr<int>(j);
+                    for (int b = 0; b < numBands; ++b) {
+                        const size_t off = static_cast<size_t>(j) * k;
+                        for (int l = 0; l < k; ++l) {
+                            mergeTopK(dj, ij, k, bandDist[b][off + l], bandIdx[b][off + l]);
+                        }
+                    }
+                }
+            });
+
+            finishTable(forward);
+            finishTable(backward);
+        }
+
+        // Extra candidates kept by matchDescriptors for the exact re-rank.
+        const int kRerankSlack = 4;
+
+        // k used by matchDescriptors: room for the ratio test plus the
+        // re-rank window.
+        int searchK(const MatcherParams& params)
+        {
+            return std::max(params.k, params.ratio > 0.0f ? 2 : 1) + kRerankSlack;
+        }
+
+        // Replace the expanded-form distances of every list by directly
+        // computed ones and restore the (distance, index) order.
+        void rerankExact(NeighbourTable& table, const cv::Mat& Q, const cv::Mat& T)
+        {
+            const int k = table.indices.cols;
+            const int D = Q.cols;
+            cv::parallel_for_(cv::Range(0, table.indices.rows), [&](const cv::Range& r) {
+                std::vector<std::pair<float, int> > cand(k);
+                for (int i = r.start; i < r.end; ++i) {
+                    float* d = table.distances.ptr<float>(i);
+                    int* j = table.indices.ptr<int>(i);
+                    int n = 0;
+                    for (int l = 0; l < k && j[l] >= 0; ++l, ++n) {
+                        cand[l].first = std::sqrt(cv::hal::normL2Sqr_(Q.ptr<float>(i), T.ptr<float>(j[l]), D));
+                        cand[l].second = j[l];
+                    }
+                    std::sort(cand.begin(), cand.begin() + n);
+                    for (int l = 0; l < n; ++l) {
+                        d[l] = cand[l].first;
+                        j[l] = cand[l].second;
+                    }
+                }
+            });
+        }
+
+        void checkInputs(const cv::Mat& desc1, const cv::Mat& desc2, const MatcherParams& params)
+        {
+            CV_Assert(desc1.channels() == 1 && desc2.channels() == 1);
+            CV_Assert(desc1.empty() || desc2.empty() || desc1.rows == desc2.rows);
+            CV_Assert(params.k >= 1 && params.blockRows >= 1 && params.blockCols >= 1);
+        }
+    }
+
+    void knnMatchBidirectional(const cv::Mat& desc1,
+        const cv::Mat& desc2,
+        NeighbourTable& forward,
+        NeighbourTable& backward,
+        const MatcherParams& params)
+    {
+        checkInputs(desc1, desc2, params);
+        knnRowMajor(toRowMajor(desc1), toRowMajor(desc2), forward, backward, params);
+    }
+
+    std::vector<cv::DMatch> matchDescriptors(const cv::Mat& desc1,
+        const cv::Mat& desc2,
+        const MatcherParams& params)
+    {
+        checkInputs(desc1, desc2, params);
+
+        MatcherParams p = params;
+        const bool useRatio = p.ratio > 0.0f;
+        p.k = searchK(params);
+
+        const cv::Mat A = toRowMajor(desc1);
+        const cv::Mat B = toRowMajor(desc2);
+        NeighbourTable fwd, bwd;
+        knnRowMajor(A, B, fwd, bwd, p);
+
+        // The expanded form loses precision for close pairs; order the
+        // candidates by their directly computed distances before deciding.
+        rerankExact(fwd, A, B);
+        rerankExact(bwd, B, A);
+
+        std::vector<cv::DMatch> matches;
+        matches.reserve(A.rows);
+        for (int i = 0; i < A.rows; ++i) {
+            const int* idx = fwd.indices.ptr<int>(i);
+            const float* dist = fwd.distances.ptr<float>(i);
+            const int j = idx[0];
+            if (j < 0) continue;
+            if (p.mutual && bwd.indices.at<int>(j, 0) != i) continue;
+            if (useRatio && idx[1] >= 0 && dist[0] >= p.ratio * dist[1]) continue;
+            matches.push_back(cv::DMatch(i, j, dist[0]));
+        }
+        return matches;
+    }
+
+    size_t matchingWorkBytes(long long N1, long long N2, int D, const MatcherParams& params, int threads)
+    {
+        const int k = searchK(params);
+        const size_t entry = sizeof(float) + sizeof(int);
+        size_t bytes = static_cast<size_t>((N1 + N2) * D) * sizeof(float);          // row-major copies
+        bytes += static_cast<size_t>(N1 + N2) * k * entry;                          // forward/backward tables
+        bytes += static_cast<size_t>(knnBandCount(N1, N2, k, params, threads)) * bandScratchBytes(N2, k);
+        bytes += static_cast<size_t>(std::max(1, threads))
+            * params.blockRows * params.blockCols * sizeof(float);                   // GEMM blocks
+        return bytes;
+    }
+}
@@ -0,0 +1,468 @@
+#include "sls/memory_plan.hpp"
+#include "sls/dense_sift.hpp"
+#include "sls/matcher.hpp"
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+namespace sls {
+
+    namespace {
+
+        const size_t kFloat = sizeof(float);
+        const int    kSiftDim = 128;
+        const int    kSubspaceDim = kSiftDim * (kSiftDim + 1) / 2;   // computeSLSDescriptors
+        // SIFT::compute with provided octave-0 keypoints converts the image to
+        // float, blurs a base image and builds 2 octaves of 6 Gaussian levels.
+        const size_t kSiftBytesPerPixel = 4 + 4 + 6 * 4 + 6 * 1;
+
+        struct ImageGeometry {
+            int       s1, s2;
+            long long points;
+            int       paddedRows, paddedCols;
+            long long octavePixels;   // padded octave images (octave mode)
+            // Per level (0 = full resolution, then octaves): padded size and
+            // the SIFT reach of its largest scale; 0 for levels without scales.
+            std::vector<int> levelRows, levelCols, levelReach;
+        };
+
+        ImageGeometry geometryFor(const cv::Size& size, const SLSOptions& opts)
+        {
+            const int gs = opts.gridSpacing;
+            const int pad = descriptorPadSize(opts);
+            ImageGeometry g;
+            g.s1 = (size.width + gs - 1) / gs;
+            g.s2 = (size.height + gs - 1) / gs;
+            g.points = static_cast<long long>(g.s1) * g.s2;
+            g.paddedRows = size.height + 2 * pad;
+            g.paddedCols = size.width + 2 * pad;
+
+            int numOctaves = 0;
+            for (float s : opts.sigma) numOctaves = std::max(numOctaves, descriptorOctave(s, opts));
+            g.levelRows.assign(numOctaves + 1, 0);
+            g.levelCols.assign(numOctaves + 1, 0);
+            g.levelReach.assign(numOctaves + 1, 0);
+            g.levelRows[0] = g.paddedRows;
+            g.levelCols[0] = g.paddedCols;
+
+            // Octave sizes follow pyrDown, borders padForDescriptors.
+            g.octavePixels = 0;
+            int w = size.width, h = size.height;
+            for (int o = 1; o <= numOctaves; ++o) {
+                w = (w + 1) / 2;
+                h = (h + 1) / 2;
+                const int octPad = octavePadSize(o, opts);
+                g.levelRows[o] = h + 2 * octPad;
+                g.levelCols[o] = w + 2 * octPad;
+                g.octavePixels += static_cast<long long>(g.levelRows[o]) * g.levelCols[o];
+            }
+            for (float s : opts.sigma) {
+                const int o = descriptorOctave(s, opts);
+                g.levelReach[o] = std::max(g.levelReach[o], descriptorReach(s / static_cast<float>(1 << o)));
+            }
+            return g;
+        }
+
+        int reducedDim(const SLSOptions& opts)
+        {
+            return (opts.dimReduction > 0 && opts.dimReduction < kSiftDim) ? opts.dimReduction : kSiftDim;
+        }
+
+        size_t siftBytes(long long rows, long long cols)
+        {
+            return static_cast<size_t>(rows * cols) * kSiftBytesPerPixel;
+        }
+
+        // Rows of level o that siftAtScale hands to SIFT for a band of R grid
+        // rows: the band's extent plus descriptorReach on both sides.
+        long long bandPixelRows(const ImageGeometry& g, int o, int R, const SLSOptions& opts)
+        {
+            long long rows = ((static_cast<long long>(R - 1) * opts.gridSpacing) >> o) + 2
+                + 2LL * g.levelReach[o];
+            return std::min<long long>(rows, g.levelRows[o]);
+        }
+
+        // SIFT scale space of the largest level band of R grid rows.
+        size_t bandSiftBytes(const ImageGeometry& g, int R, const SLSOptions& opts)
+        {
+            size_t bytes = 0;
+            for (size_t o = 0; o < g.levelReach.size(); ++o) {
+                if (g.levelReach[o] == 0) continue;
+                const int lo = static_cast<int>(o);
+                bytes = std::max(bytes, siftBytes(bandPixelRows(g, lo, R, opts), g.levelCols[o]));
+            }
+            return bytes;
+        }
+
+        // Columns centred at a time by ColumnMoments::add.
+        const int kMomentChunkCols = 4096;
+
+        // Running mean and scatter of descriptor columns. Bands are merged
+        // with the pairwise update of Chan et al., so the banded path fits
+        // PCA on every sample, as pcaReduce does on the whole grids.
+        struct ColumnMoments {
+            double  n;
+            cv::Mat mean;      // D x 1, CV_64F
+            cv::Mat scatter;   // D x D, CV_64F
+            std::mutex mtx;
+
+            ColumnMoments() : n(0.0) {}
+
+            void add(const cv::Mat& dp)
+            {
+                if (dp.cols == 0) return;
+                cv::Mat bandMean;
+                cv::reduce(dp, bandMean, 1, cv::REDUCE_AVG, CV_64F);
+
+                // Centre a bounded chunk of columns at a time so the band is
+                // never copied whole.
+                const int D = dp.rows;
+                cv::Mat bandScatter = cv::Mat::zeros(D, D, CV_64F);
+                cv::Mat chunk(D, std::min(dp.cols, kMomentChunkCols), CV_32F), part;
+                for (int c0 = 0; c0 < dp.cols; c0 += kMomentChunkCols) {
+                    const int c1 = std::min(dp.cols, c0 + kMomentChunkCols);
+                    cv::Mat centred = chunk.colRange(0, c1 - c0);
+                    for (int r = 0; r < D; ++r) {
+                        cv::subtract(dp.row(r).colRange(c0, c1), cv::Scalar(bandMean.at<double>(r)), centred.row(r));
+                    }
+                    cv::gemm(centred, centred, 1.0, cv::noArray(), 0.0, part, cv::GEMM_2_T);
+                    cv::add(bandScatter, part, bandScatter, cv::noArray(), CV_64F);
+                }
+
+                const double m = dp.cols;
+                std::lock_guard<std::mutex> lk(mtx);
+                if (n == 0.0) {
+                    mean = bandMean;
+                    scatter = bandScatter;
+                }
+                else {
+                    const cv::Mat delta = bandMean - mean;
+                    scatter += bandScatter + delta * delta.t() * (n * m / (n + m));
+                    mean += delta * (m / (n + m));
+                }
+                n += m;
+            }
+
+            // PCA of the accumulated samples with `dims` components, in the
+            // DATA_AS_ROW layout cv::PCA::project expects.
+            cv::PCA fit(int dims) const
+            {
+                cv::Mat evals, evecs;
+                cv::eigen(scatter / n, evals, evecs);
+                cv::PCA pca;
+                mean.t().convertTo(pca.mean, CV_32F);
+                evecs.rowRange(0, dims).convertTo(pca.eigenvectors, CV_32F);
+                evals.rowRange(0, dims).convertTo(pca.eigenvalues, CV_32F);
+                return pca;
+            }
+        };
+
+        // Bytes one band of R grid rows holds while it is extracted, added to
+        // the PCA moments and averaged.
+        size_t bandBytes(const ImageGeometry& g, int R, const SLSOptions& opts)
+        {
+            const long long S = static_cast<long long>(opts.sigma.size());
+            const int Dr = reducedDim(opts);
+            const long long P = static_cast<long long>(R) * g.s1;
+            size_t bytes = bandSiftBytes(g, R, opts);
+            bytes += static_cast<size_t>(P * kSiftDim) * kFloat;            // per-sigma SIFT output
+            bytes += static_cast<size_t>(P * S * kSiftDim) * kFloat;        // band dpMat
+            if (Dr < kSiftDim) {
+                // Centred chunk and scatter matrices of ColumnMoments::add.
+                bytes += static_cast<size_t>(std::min<long long>(P * S, kMomentChunkCols) * kSiftDim) * kFloat;
+                bytes += static_cast<size_t>(kSiftDim * kSiftDim) * (kFloat + 2 * sizeof(double));
+            }
+            bytes += static_cast<size_t>(P * kSiftDim) * kFloat;            // averaged band
+            return bytes;
+        }
+
+        // Same formula matchDescriptors sizes its band lists with.
+        size_t matchingBytes(long long P1, long long P2, int Dr, int threads)
+        {
+            return matchingWorkBytes(P1, P2, Dr, MatcherParams(), threads);
+        }
+
+        size_t peakOf(const std::vector<StageMemory>& stages)
+        {
+            size_t peak = 0;
+            for (const StageMemory& s : stages) peak = std::max(peak, s.bytes);
+            return peak;
+        }
+
+        StageMemory stage(const char* name, size_t bytes)
+        {
+            StageMemory s;
+            s.name = name;
+            s.bytes = bytes;
+            return s;
+        }
+
+        double toMB(size_t bytes)
+        {
+            return bytes / (1024.0 * 1024.0);
+        }
+    }
+
+    MemoryPlan planMemory(const SLSOptions& opts,
+        const cv::Size& imageSize1,
+        const cv::Size& imageSize2,
+        const MemoryPlanParams& params)
+    {
+        CV_Assert(!opts.sigma.empty() && opts.gridSpacing >= 1);
+
+        MemoryPlan plan;
+        plan.budgetBytes = params.budgetBytes;
+        plan.threads = params.maxThreads > 0 ? params.maxThreads : std::max(1, cv::getNumThreads());
+        plan.tileRows = 0;
+        plan.tiledPeakBytes = 0;
+
+        const ImageGeometry g1 = geometryFor(imageSize1, opts);
+        const ImageGeometry g2 = geometryFor(imageSize2, opts);
+        plan.grid1 = cv::Size(g1.s1, g1.s2);
+        plan.grid2 = cv::Size(g2.s1, g2.s2);
+
+        const long long S = static_cast<long long>(opts.sigma.size());
+        const int Dr = reducedDim(opts);
+        const bool pcaOn = Dr < kSiftDim;
+
+        const size_t inputs = static_cast<size_t>(imageSize1.area()) + imageSize2.area();
+        const size_t padded = static_cast<size_t>(g1.paddedRows) * g1.paddedCols
+            + static_cast<size_t>(g2.paddedRows) * g2.paddedCols
+            + static_cast<size_t>(g1.octavePixels + g2.octavePixels);
+        const size_t dp1 = static_cast<size_t>(g1.points * S * kSiftDim) * kFloat;
+        const size_t dp2 = static_cast<size_t>(g2.points * S * kSiftDim) * kFloat;
+        const size_t red1 = static_cast<size_t>(g1.points * S * Dr) * kFloat;
+        const size_t red2 = static_cast<size_t>(g2.points * S * Dr) * kFloat;
+        const size_t out1 = static_cast<size_t>(g1.points * Dr) * kFloat;
+        const size_t out2 = static_cast<size_t>(g2.points * Dr) * kFloat;
+        const size_t outs = out1 + out2;
+
+        // --- Whole-image path (extractScalelessDescs) ---
+        const size_t sift1 = siftBytes(g1.paddedRows, g1.paddedCols)
+            + static_cast<size_t>(g1.points * kSiftDim) * kFloat;
+        const size_t sift2 = siftBytes(g2.paddedRows, g2.paddedCols)
+            + static_cast<size_t>(g2.points * kSiftDim) * kFloat;
+
+        plan.stages.push_back(stage("load + pad", inputs + padded));
+        plan.stages.push_back(stage("dense SIFT",
+            inputs + padded + std::max(dp1 + sift1, dp1 + dp2 + sift2)));
+        if (pcaOn) {
+            // Inputs, their transposes, the stacked sample matrix, and three
+            // copies of every projection (project, transpose, clone).
+            plan.stages.push_back(stage("PCA", inputs + 3 * (dp1 + dp2) + 3 * (red1 + red2)
+                + static_cast<size_t>(kSiftDim) * kSiftDim * sizeof(double)));
+        }
+        else {
+            plan.stages.push_back(stage("PCA (disabled, copy)", inputs + 2 * (dp1 + dp2)));
+        }
+        plan.stages.push_back(stage("scale averaging", inputs + dp1 + dp2 + red1 + red2 + outs));
+        if (params.subspace) {
+            const size_t sub = 2 * static_cast<size_t>(std::max(g1.points, g2.points))
+                * kSubspaceDim * kFloat;
+            plan.stages.push_back(stage("subspace descriptors", outs + std::max(dp1, dp2) + sub));
+        }
+        if (params.matching) {
+            plan.stages.push_back(stage("matching", inputs + outs
+                + matchingBytes(g1.points, g2.points, Dr, plan.threads)));
+        }
+        plan.peakBytes = peakOf(plan.stages);
+
+        if (params.budgetBytes == 0 || plan.peakBytes <= params.budgetBytes) {
+            plan.fits = true;
+            return plan;
+        }
+
+        // --- Banded path: pick rows per band and concurrent bands ---
+        // With PCA on, bands keep full-dimension scale averages; the basis is
+        // only known once every band has been seen.
+        const size_t full1 = static_cast<size_t>(g1.points * kSiftDim) * kFloat;
+        const size_t full2 = static_cast<size_t>(g2.points * kSiftDim) * kFloat;
+        const size_t budget = params.budgetBytes;
+        const size_t resident = inputs + padded + (pcaOn ? full1 + full2 : outs);
+        const int maxRows = std::max(g1.s2, g2.s2);
+        const ImageGeometry& wide = g1.paddedCols >= g2.paddedCols ? g1 : g2;
+
+        auto largestBand = [&](int threads) {
+            int lo = 0, hi = maxRows;
+            while (lo < hi) {
+                int mid = (lo + hi + 1) / 2;
+                if (resident + threads * bandBytes(wide, mid, opts) <= budget) lo = mid;
+                else hi = mid - 1;
+            }
+            return lo;
+        };
+
+        double bestScore = 0.0;
+        int bestRows = 0, bestThreads = 0;
+        for (int t = plan.threads; t >= 1; --t) {
+            int R = largestBand(t);
+            if (R == 0) continue;
+            // Useful pixels per SIFT pixel: small bands spend most of their
+            // time on the descriptor reach around them.
+            double efficiency = static_cast<double>(siftBytes(static_cast<long long>(R) * opts.gridSpacing,
+                wide.paddedCols)) / bandSiftBytes(wide, R, opts);
+            double score = t * efficiency;
+            if (score > bestScore) {
+                bestScore = score;
+                bestRows = R;
+                bestThreads = t;
+            }
+        }
+
+        const int R = std::max(bestRows, 1);
+        const int T = std::max(bestThreads, 1);
+        plan.tileRows = R;
+        plan.threads = T;
+
+        plan.tiledStages.push_back(stage("load + pad", inputs + padded));
+        plan.tiledStages.push_back(stage("banded extraction", resident + T * bandBytes(wide, R, opts)));
+        if (pcaOn) {
+            // Each image: transpose, projection and its transpose.
+            plan.tiledStages.push_back(stage("PCA projection", inputs + full1 + full2
+                + std::max(full1 + 2 * out1, full2 + 2 * out2) + outs));
+        }
+        if (params.subspace) {
+            const size_t sub = 2 * static_cast<size_t>(std::max(g1.points, g2.points))
+                * kSubspaceDim * kFloat;
+            plan.tiledStages.push_back(stage("subspace descriptors", outs + std::max(dp1, dp2) + sub));
+        }
+        if (params.matching) {
+            plan.tiledStages.push_back(stage("matching", inputs + outs
+                + matchingBytes(g1.points, g2.points, Dr, T)));
+        }
+        plan.tiledPeakBytes = peakOf(plan.tiledStages);
+        plan.fits = bestRows > 0 && plan.tiledPeakBytes <= budget;
+        return plan;
+    }
+
+    void printMemoryPlan(std::ostream& os, const MemoryPlan& plan)
+    {
+        std::ios::fmtflags flags = os.flags();
+        os << std::fixed << std::setprecision(1);
+
+        os << "Grids: " << plan.grid1.width << " x " << plan.grid1.height << ", "
+            << plan.grid2.width << " x " << plan.grid2.height << "\n";
+        os << "Whole-image extraction:\n";
+        for (const StageMemory& s : plan.stages) {
+            os << "  " << std::left << std::setw(24) << s.name << std::right
+                << std::setw(10) << toMB(s.bytes) << " MB\n";
+        }
+        os << "  " << std::left << std::setw(24) << "peak" << std::right
+            << std::setw(10) << toMB(plan.peakBytes) << " MB\n";
+
+        if (plan.budgetBytes > 0) {
+            os << "Budget: " << toMB(plan.budgetBytes) << " MB\n";
+        }
+        if (plan.tileRows > 0) {
+            os << "Banded extraction: " << plan.tileRows << " grid rows per band, "
+                << plan.threads << " band(s) at a time\n";
+            for (const StageMemory& s : plan.tiledStages) {
+                os << "  " << std::left << std::setw(24) << s.name << std::right
+                    << std::setw(10) << toMB(s.bytes) << " MB\n";
+            }
+            os << "  " << std::left << std::setw(24) << "peak" << std::right
+                << std::setw(10) << toMB(plan.tiledPeakBytes) << " MB\n";
+        }
+        else {
+            os << "Recommended: whole-image extraction, " << plan.threads << " thread(s)\n";
+        }
+        os << (plan.fits ? "Fits the budget.\n" : "Does NOT fit the budget.\n");
+        os.flags(flags);
+    }
+
+    SLSOutput extractScalelessDescsWithinBudget(const cv::Mat& I1,
+        const cv::Mat& I2,
+        const SLSOptions& opts,
+        const MemoryPlanParams& params)
+    {
+        SLSOutput out;
+        if (I1.empty() || I2.empty()) {
+            std::cerr << "extractScalelessDescsWithinBudget: one of the input images is empty.\n";
+            return out;
+        }
+
+        MemoryPlanParams p = params;
+        p.matching = false;
+        p.subspace = false;
+        const MemoryPlan plan = planMemory(opts, I1.size(), I2.size(), p);
+        if (!plan.fits) {
+            std::cerr << "extractScalelessDescsWithinBudget: predicted peak "
+                << toMB(plan.tileRows > 0 ? plan.tiledPeakBytes : plan.peakBytes)
+                << " MB exceeds the " << toMB(plan.budgetBytes) << " MB budget.\n";
+            return out;
+        }
+        if (plan.tileRows == 0) {
+            return extractScalelessDescs(I1, I2, opts);
+        }
+
+        std::cout << "[SLS] Memory budget " << toMB(plan.budgetBytes) << " MB: banded extraction, "
+            << plan.tileRows << " grid rows x " << plan.threads << " band(s), predicted peak "
+            << toMB(plan.tiledPeakBytes) << " MB.\n";
+
+        const PaddedImage pad1 = padForDescriptors(I1, opts);
+        const PaddedImage pad2 = padForDescriptors(I2, opts);
+        const int numSigma = static_cast<int>(opts.sigma.size());
+        const int Dr = reducedDim(opts);
+        const bool pcaOn = Dr < kSiftDim;
+
+        // Bands keep full-dimension scale averages and feed every sample to
+        // the PCA moments; projecting the averages afterwards equals
+        // averaging the projections, as extractScalelessDescs does.
+        ColumnMoments moments;
+
+        auto extractBanded = [&](const PaddedImage& pad, const cv::Size& grid) {
+            cv::Mat desc(kSiftDim, grid.width * grid.height, CV_32F);
+            const int numBands = (grid.height + plan.tileRows - 1) / plan.tileRows;
+
+            // At most plan.threads bands are in flight at any time.
+            for (int start = 0; start < numBands; start += plan.threads) {
+                const int end = std::min(numBands, start + plan.threads);
+                cv::parallel_for_(cv::Range(start, end), [&](const cv::Range& r) {
+                    cv::Ptr<cv::SIFT> sift = cv::SIFT::create();
+                    for (int b = r.start; b < r.end; ++b) {
+                        const int row0 = b * plan.tileRows;
+                        DescriptorGrid g = generateDescriptorRows(pad, opts, sift, row0, row0 + plan.tileRows);
+                        if (g.numPoints == 0) continue;
+
+                        if (pcaOn) moments.add(g.dpMat);
+                        cv::Mat avg = averageAcrossScales(g.dpMat, g.numPoints, numSigma);
+                        const int col0 = row0 * grid.width;
+                        avg.copyTo(desc.colRange(col0, col0 + g.numPoints));
+                    }
+                });
+            }
+            return desc;
+        };
+
+        out.grid1 = plan.grid1;
+        out.grid2 = plan.grid2;
+        std::cout << "[SLS] Banded descriptors for image 1...\n";
+        out.desc1 = extractBanded(pad1, out.grid1);
+        std::cout << "[SLS] Banded descriptors for image 2...\n";
+        out.desc2 = extractBanded(pad2, out.grid2);
+
+        if (pcaOn) {
+            std::cout << "[SLS] Running PCA with target dim = " << Dr << " on "
+                << static_cast<long long>(moments.n) << " samples of dim " << kSiftDim << "...\n";
+            const cv::PCA pca = moments.fit(Dr);
+            cv::Mat* descs[2] = { &out.desc1, &out.desc2 };
+            for (cv::Mat* d : descs) {
+                cv::Mat proj;
+                pca.project(d->t(), proj);
+                *d = proj.t();
+            }
+            out.pcaBasis = pca.eigenvectors.clone();
+        }
+        else {
+            out.pcaBasis = cv::Mat::eye(kSiftDim, kSiftDim, CV_32F);
+        }
+
+        std::cout << "[SLS] Finished banded extraction.\n";
+        return out;
+    }
+}
@@ -0,0 +1,276 @@
+#include "sls/progressive.hpp"
+#include "sls/dense_sift.hpp"
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace sls {
+
+    namespace {
+
+        // Scale indices ordered so that every prefix spreads over the whole
+        // range: middle first, then the middles of the halves, and so on.
+        std::vector<int> coarseToFineOrder(int numSigma)
+        {
+            std::vector<int> order;
+            std::deque<std::pair<int, int> > spans;
+            spans.push_back(std::make_pair(0, numSigma - 1));
+            while (!spans.empty()) {
+                std::pair<int, int> s = spans.front();
+                spans.pop_front();
+                if (s.first > s.second) continue;
+                int mid = (s.first + s.second) / 2;
+                order.push_back(mid);
+                spans.push_back(std::make_pair(s.first, mid - 1));
+                spans.push_back(std::make_pair(mid + 1, s.second));
+            }
+            return order;
+        }
+
+        // SIFT descriptors of one image at the grid of the last completed
+        // level, per scale index, so the next level only computes new points
+        // and new scales.
+        struct ImageState {
+            PaddedImage pad;
+            int step;
+            int s1, s2;
+            std::map<int, cv::Mat> bySigma;   // numPoints x 128
+
+            ImageState() : step(0), s1(0), s2(0) {}
+        };
+
+        // Descriptors at grid step `step` for the scale indices in `sigmaIdx`
+        // (ascending). Returns an empty grid when cancelled.
+        DescriptorGrid refineImage(ImageState& st,
+            const SLSOptions& opts,
+            int step,
+            const std::vector<int>& sigmaIdx,
+            const cv::Ptr<cv::SIFT>& sift,
+            const std::atomic<bool>& cancelled)
+        {
+            DescriptorGrid out;
+            out.numPoints = 0;
+            out.s1 = out.s2 = 0;
+
+            const int pad = st.pad.padSize;
+            const int W = st.pad.padded.cols - 2 * pad;
+            const int H = st.pad.padded.rows - 2 * pad;
+            const int g = opts.gridSpacing * step;
+            const int s1 = (W + g - 1) / g;
+            const int s2 = (H + g - 1) / g;
+            const int P = s1 * s2;
+
+            // Points of the previous grid keep their descriptors.
+            const bool nested = st.step > 0 && st.step % step == 0;
+            const int r = nested ? st.step / step : 1;
+            std::vector<cv::Point2f> all, fresh;
+            std::vector<int> prevIndex(P, -1);
+            all.reserve(P);
+            for (int i = 0; i < s2; ++i) {
+                for (int j = 0; j < s1; ++j) {
+                    cv::Point2f pt(static_cast<float>(pad + j * g), static_cast<float>(pad + i * g));
+                    all.push_back(pt);
+                    if (nested && i % r == 0 && j % r == 0) {
+                        prevIndex[i * s1 + j] = (i / r) * st.s1 + j / r;
+                    }
+                    else {
+                        fresh.push_back(pt);
+                    }
+                }
+            }
+
+            std::map<int, cv::Mat> next;
+            for (int si : sigmaIdx) {
+                if (cancelled) return out;
+
+                std::map<int, cv::Mat>::const_iterator cached = st.bySigma.find(si);
+                if (!nested || cached == st.bySigma.end()) {
+                    next[si] = siftAtScale(st.pad, all, opts.sigma[si], opts, sift);
+                    continue;
+                }
+
+                cv::Mat f = siftAtScale(st.pad, fresh, opts.sigma[si], opts, sift);
+                cv::Mat d(P, f.cols, CV_32F);
+                int k = 0;
+                for (int p = 0; p < P; ++p) {
+                    if (prevIndex[p] >= 0) cached->second.row(prevIndex[p]).copyTo(d.row(p));
+                    else f.row(k++).copyTo(d.row(p));
+                }
+                next[si] = d;
+            }
+
+            // Same layout as generateDescriptors: column si + i * numSigma.
+            const int S = static_cast<int>(sigmaIdx.size());
+            const int D = 128;
+            // Interleave the rows point-major, then transpose once.
+            cv::Mat rows(P * S, D, CV_32F);
+            for (int s = 0; s < S; ++s) {
+                const cv::Mat& d = next[sigmaIdx[s]];
+                for (int p = 0; p < P; ++p) {
+                    d.row(p).copyTo(rows.row(s + p * S));
+                }
+            }
+            cv::transpose(rows, out.dpMat);
+            out.numPoints = P;
+            out.s1 = s1;
+            out.s2 = s2;
+
+            st.bySigma.swap(next);
+            st.step = step;
+            st.s1 = s1;
+            st.s2 = s2;
+            return out;
+        }
+    }
+
+    struct ProgressiveExtractor::Impl {
+        SLSOptions        opts;
+        ProgressiveParams params;
+        Callback          onResult;
+        ImageState        images[2];
+
+        std::atomic<bool> cancelled;
+        std::atomic<bool> finished;
+        mutable std::mutex mtx;
+        ProgressiveResult latest;
+        std::promise<ProgressiveResult> promise;
+        std::shared_future<ProgressiveResult> future;
+        std::thread worker;
+
+        Impl() : cancelled(false), finished(false) {}
+
+        // Resolves the promise with the last completed level, or with the
+        // exception thrown by extraction or the callback.
+        void run()
+        {
+            ProgressiveResult last;
+            std::exception_ptr error;
+            try {
+                last = runLevels();
+            }
+            catch (...) {
+                error = std::current_exception();
+            }
+            finished = true;
+            if (error) promise.set_exception(error);
+            else promise.set_value(last);
+        }
+
+        ProgressiveResult runLevels()
+        {
+            const int64_t start = cv::getTickCount();
+
+            std::vector<ProgressiveLevel> levels = params.levels;
+            if (levels.empty() || levels.back().gridStep != 1 || levels.back().sigmaFraction < 1.0f) {
+                levels.push_back(ProgressiveLevel(1, 1.0f));
+            }
+
+            const int numSigma = static_cast<int>(opts.sigma.size());
+            const std::vector<int> order = coarseToFineOrder(numSigma);
+            cv::Ptr<cv::SIFT> sifts[2] = { cv::SIFT::create(), cv::SIFT::create() };
+
+            for (size_t l = 0; l < levels.size() && !cancelled; ++l) {
+                const int step = std::max(1, levels[l].gridStep);
+                int count = static_cast<int>(std::ceil(levels[l].sigmaFraction * numSigma));
+                count = std::min(numSigma, std::max(1, count));
+                const bool isFinal = step == 1 && count == numSigma;
+
+                std::vector<int> sigmaIdx(order.begin(), order.begin() + count);
+                std::sort(sigmaIdx.begin(), sigmaIdx.end());
+
+                SLSOptions levelOpts = opts;
+                levelOpts.gridSpacing = opts.gridSpacing * step;
+                levelOpts.sigma.clear();
+                for (int si : sigmaIdx) levelOpts.sigma.push_back(opts.sigma[si]);
+
+                DescriptorGrid grids[2];
+                cv::parallel_for_(cv::Range(0, 2), [&](const cv::Range& r) {
+                    for (int i = r.start; i < r.end; ++i) {
+                        grids[i] = refineImage(images[i], opts, step, sigmaIdx, sifts[i], cancelled);
+                    }
+                });
+                if (cancelled || grids[0].numPoints == 0 || grids[1].numPoints == 0) break;
+
+                ProgressiveResult res;
+                res.level = static_cast<int>(l);
+                res.final = isFinal;
+                res.output = extractScalelessDescs(grids[0], grids[1], levelOpts);
+                res.opts = levelOpts;
+                res.elapsedMs = (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+                if (res.output.desc1.empty()) break;
+
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    latest = res;
+                }
+                if (onResult) onResult(res);
+                if (isFinal) break;
+            }
+
+            std::lock_guard<std::mutex> lock(mtx);
+            return latest;
+        }
+    };
+
+    ProgressiveExtractor::ProgressiveExtractor(const cv::Mat& I1,
+        const cv::Mat& I2,
+        const SLSOptions& opts,
+        const ProgressiveParams& params,
+        const Callback& onResult)
+        : impl(new Impl)
+    {
+        impl->opts = opts;
+        impl->params = params;
+        impl->onResult = onResult;
+        impl->future = impl->promise.get_future().share();
+
+        if (I1.empty() || I2.empty() || opts.sigma.empty()) {
+            std::cerr << "ProgressiveExtractor: empty input image or no scales.\n";
+            impl->finished = true;
+            impl->promise.set_value(ProgressiveResult());
+            return;
+        }
+
+        impl->images[0].pad = padForDescriptors(I1, opts);
+        impl->images[1].pad = padForDescriptors(I2, opts);
+        Impl* p = impl.get();
+        impl->worker = std::thread([p]() { p->run(); });
+    }
+
+    ProgressiveExtractor::~ProgressiveExtractor()
+    {
+        impl->cancelled = true;
+        if (impl->worker.joinable()) impl->worker.join();
+    }
+
+    void ProgressiveExtractor::cancel()
+    {
+        impl->cancelled = true;
+    }
+
+    bool ProgressiveExtractor::done() const
+    {
+        return impl->finished;
+    }
+
+    ProgressiveResult ProgressiveExtractor::latest() const
+    {
+        std::lock_guard<std::mutex> lock(impl->mtx);
+        return impl->latest;
+    }
+
+    std::shared_future<ProgressiveResult> ProgressiveExtractor::finalResult() const
+    {
+        return impl->future;
+    }
+}
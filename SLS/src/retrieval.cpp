@@ -0,0 +1,427 @@
+#include "sls/retrieval.hpp"
+#include "sls/dense_sift.hpp"
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/core/hal/hal.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+
+namespace sls {
+
+    cv::Mat describeImage(const cv::Mat& grayImage, const SLSOptions& opts)
+    {
+        DescriptorGrid dp = generateDescriptors(grayImage, opts);
+        if (dp.numPoints == 0) {
+            return cv::Mat();
+        }
+        return averageAcrossScales(dp.dpMat, dp.numPoints, static_cast<int>(opts.sigma.size()));
+    }
+
+    RetrievalIndex::RetrievalIndex()
+        : wordCount(0),
+        dirty(false)
+    {
+    }
+
+    bool RetrievalIndex::train(const std::vector<cv::Mat>& descriptors,
+        const SLSOptions& options,
+        const VocabularyParams& params)
+    {
+        CV_Assert(params.branching >= 2 && params.levels >= 1 && params.maxTrainSamples > 0);
+
+        int total = 0, dim = 0;
+        for (const cv::Mat& d : descriptors) {
+            if (d.empty()) continue;
+            CV_Assert(dim == 0 || d.rows == dim);
+            dim = d.rows;
+            total += d.cols;
+        }
+        if (total < params.branching) {
+            std::cerr << "RetrievalIndex::train: only " << total
+                << " descriptors, need at least " << params.branching << ".\n";
+            return false;
+        }
+
+        // Uniform subsample of all descriptor columns, one sample per row.
+        cv::RNG rng(params.seed);
+        const double keep = std::min(1.0, static_cast<double>(params.maxTrainSamples) / total);
+        std::vector<float> data;
+        data.reserve(static_cast<size_t>(std::min(total, params.maxTrainSamples) + 1024) * dim);
+        for (const cv::Mat& d : descriptors) {
+            if (d.empty()) continue;
+            cv::Mat d32;
+            d.convertTo(d32, CV_32F);
+            for (int c = 0; c < d32.cols; ++c) {
+                if (keep < 1.0 && rng.uniform(0.0, 1.0) >= keep) continue;
+                for (int r = 0; r < dim; ++r) {
+                    data.push_back(d32.at<float>(r, c));
+                }
+            }
+        }
+        cv::Mat samples(static_cast<int>(data.size() / dim), dim, CV_32F, data.data());
+        if (samples.rows < params.branching) {
+            std::cerr << "RetrievalIndex::train: too few samples after subsampling.\n";
+            return false;
+        }
+
+        std::cout << "[RETRIEVAL] Fitting PCA on " << samples.rows << " samples of dim " << dim << "...\n";
+        opts = options;
+        pca = cv::PCA(samples, cv::noArray(), cv::PCA::DATA_AS_ROW, params.pcaDim);
+        cv::Mat projected = pca.project(samples);
+
+        // cv::kmeans draws its initial centers from theRNG(); seed it so the
+        // vocabulary is reproducible, and leave the caller's state alone.
+        const uint64_t savedState = cv::theRNG().state;
+        cv::theRNG().state = params.seed;
+
+        std::cout << "[RETRIEVAL] Building vocabulary tree (branching " << params.branching
+            << ", levels " << params.levels << ")...\n";
+        nodes.clear();
+        wordCount = 0;
+        buildNode(projected, 0, params);
+        cv::theRNG().state = savedState;
+
+        idf.assign(wordCount, 0.0f);
+        postings.assign(wordCount, std::vector<Posting>());
+        names.clear();
+        dirty = false;
+
+        std::cout << "[RETRIEVAL] Vocabulary has " << wordCount << " words over "
+            << nodes.size() << " nodes, descriptor dim " << projected.cols << ".\n";
+        return true;
+    }
+
+    // Cluster `samples` into params.branching children and recurse into
+    // every child that is deep enough and large enough to be split again.
+    int RetrievalIndex::buildNode(const cv::Mat& samples, int depth, const VocabularyParams& params)
+    {
+        const int K = params.branching;
+        cv::Mat labels, centers;
+        cv::kmeans(samples, K, labels,
+            cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, params.kmeansIterations, 1e-4),
+            1, cv::KMEANS_PP_CENTERS, centers);
+
+        const int id = static_cast<int>(nodes.size());
+        nodes.push_back(Node());
+        nodes[id].centers = centers;
+        nodes[id].children.assign(K, 0);
+
+        std::vector<int> sizes(K, 0);
+        for (int i = 0; i < samples.rows; ++i) {
+            ++sizes[labels.at<int>(i)];
+        }
+
+        const bool canSplit = depth + 1 < params.levels;
+        std::vector<cv::Mat> subsets(K);
+        std::vector<int> filled(K, 0);
+        if (canSplit) {
+            for (int c = 0; c < K; ++c) {
+                if (sizes[c] >= 2 * K) subsets[c].create(sizes[c], samples.cols, CV_32F);
+            }
+            for (int i = 0; i < samples.rows; ++i) {
+                int c = labels.at<int>(i);
+                if (!subsets[c].empty()) samples.row(i).copyTo(subsets[c].row(filled[c]++));
+            }
+        }
+
+        for (int c = 0; c < K; ++c) {
+            if (!subsets[c].empty()) {
+                int child = buildNode(subsets[c], depth + 1, params);
+                nodes[id].children[c] = child;
+            }
+            else {
+                nodes[id].children[c] = -(wordCount++) - 1;
+            }
+        }
+        return id;
+    }
+
+    // descriptors (D x N) -> N x dim rows in the PCA space.
+    cv::Mat RetrievalIndex::reduce(const cv::Mat& descriptors) const
+    {
+        cv::Mat rows;
+        descriptors.t().convertTo(rows, CV_32F);
+        return pca.project(rows);
+    }
+
+    std::vector<int> RetrievalIndex::quantize(const cv::Mat& descriptors) const
+    {
+        std::vector<int> words;
+        if (!trained() || descriptors.empty()) {
+            return words;
+        }
+        CV_Assert(descriptors.rows == pca.mean.cols);
+
+        const cv::Mat R = reduce(descriptors);
+        const int dim = R.cols;
+        words.resize(R.rows);
+
+        cv::parallel_for_(cv::Range(0, R.rows), [&](const cv::Range& r) {
+            for (int i = r.start; i < r.end; ++i) {
+                const float* x = R.ptr<float>(i);
+                int node = 0;
+                for (;;) {
+                    const Node& n = nodes[node];
+                    int best = 0;
+                    float bestDist = cv::hal::normL2Sqr_(x, n.centers.ptr<float>(0), dim);
+                    for (int c = 1; c < n.centers.rows; ++c) {
+                        float d = cv::hal::normL2Sqr_(x, n.centers.ptr<float>(c), dim);
+                        if (d < bestDist) {
+                            bestDist = d;
+                            best = c;
+                        }
+                    }
+                    int child = n.children[best];
+                    if (child < 0) {
+                        words[i] = -child - 1;
+                        break;
+                    }
+                    node = child;
+                }
+            }
+        });
+        return words;
+    }
+
+    // (word, count) pairs of one image, sorted by word.
+    void RetrievalIndex::countWords(const cv::Mat& descriptors, std::vector<cv::Vec2i>& wordCounts) const
+    {
+        std::vector<int> words = quantize(descriptors);
+        std::sort(words.begin(), words.end());
+
+        wordCounts.clear();
+        for (size_t i = 0; i < words.size();) {
+            size_t j = i;
+            while (j < words.size() && words[j] == words[i]) ++j;
+            wordCounts.push_back(cv::Vec2i(words[i], static_cast<int>(j - i)));
+            i = j;
+        }
+    }
+
+    int RetrievalIndex::add(const cv::Mat& descriptors, const std::string& name)
+    {
+        CV_Assert(trained());
+
+        std::vector<cv::Vec2i> wordCounts;
+        countWords(descriptors, wordCounts);
+
+        const int id = static_cast<int>(names.size());
+        names.push_back(name);
+        for (const cv::Vec2i& wc : wordCounts) {
+            Posting p;
+            p.image = id;
+            p.count = wc[1];
+            p.weight = 0.0f;
+            postings[wc[0]].push_back(p);
+        }
+        dirty = true;
+        return id;
+    }
+
+    void RetrievalIndex::finalize()
+    {
+        const int N = numImages();
+        std::vector<double> norm2(N, 0.0);
+
+        for (int w = 0; w < wordCount; ++w) {
+            const std::vector<Posting>& list = postings[w];
+            // Smoothed so that words in every reference (and a one-image
+            // index) still carry weight instead of zeroing all vectors.
+            idf[w] = list.empty() ? 0.0f
+                : static_cast<float>(std::log((N + 1.0) / (list.size() + 1.0)) + 1.0);
+            for (const Posting& p : list) {
+                double v = p.count * static_cast<double>(idf[w]);
+                norm2[p.image] += v * v;
+            }
+        }
+
+        for (int w = 0; w < wordCount; ++w) {
+            for (Posting& p : postings[w]) {
+                double n = std::sqrt(norm2[p.image]);
+                p.weight = n > 0.0 ? static_cast<float>(p.count * idf[w] / n) : 0.0f;
+            }
+        }
+        dirty = false;
+    }
+
+    std::vector<RetrievalHit> RetrievalIndex::query(const cv::Mat& descriptors, int topK) const
+    {
+        std::vector<RetrievalHit> hits;
+        if (!trained() || numImages() == 0) {
+            return hits;
+        }
+        if (dirty) {
+            std::cerr << "RetrievalIndex::query: references were added after finalize().\n";
+            return hits;
+        }
+
+        std::vector<cv::Vec2i> wordCounts;
+        countWords(descriptors, wordCounts);
+
+        double qNorm2 = 0.0;
+        for (const cv::Vec2i& wc : wordCounts) {
+            double v = wc[1] * static_cast<double>(idf[wc[0]]);
+            qNorm2 += v * v;
+        }
+        if (qNorm2 <= 0.0) {
+            return hits;
+        }
+        const double qScale = 1.0 / std::sqrt(qNorm2);
+
+        // Only references sharing a word with the query are touched.
+        std::vector<float> scores(numImages(), 0.0f);
+        for (const cv::Vec2i& wc : wordCounts) {
+            const float qw = static_cast<float>(wc[1] * idf[wc[0]] * qScale);
+            if (qw == 0.0f) continue;
+            for (const Posting& p : postings[wc[0]]) {
+                scores[p.image] += qw * p.weight;
+            }
+        }
+
+        std::vector<int> order;
+        for (int i = 0; i < numImages(); ++i) {
+            if (scores[i] > 0.0f) order.push_back(i);
+        }
+        const size_t k = std::min(order.size(), static_cast<size_t>(std::max(0, topK)));
+        std::partial_sort(order.begin(), order.begin() + k, order.end(),
+            [&](int a, int b) {
+                return scores[a] > scores[b] || (scores[a] == scores[b] && a < b);
+            });
+
+        for (size_t i = 0; i < k; ++i) {
+            RetrievalHit h;
+            h.image = order[i];
+            h.name = names[order[i]];
+            h.score = scores[order[i]];
+            hits.push_back(h);
+        }
+        return hits;
+    }
+
+    bool RetrievalIndex::save(const std::string& path) const
+    {
+        try {
+            cv::FileStorage fs(path, cv::FileStorage::WRITE);
+            if (!fs.isOpened()) {
+                std::cerr << "RetrievalIndex::save: could not open " << path << "\n";
+                return false;
+            }
+
+            fs << "sigma" << opts.sigma;
+            fs << "gridSpacing" << opts.gridSpacing;
+            fs << "dimReduction" << opts.dimReduction;
+            fs << "dimReductionCov" << opts.dimReductionCov;
+            fs << "subsDim" << opts.subsDim;
+            fs << "octaveSigma" << opts.octaveSigma;
+
+            fs << "pcaMean" << pca.mean;
+            fs << "pcaEigenvectors" << pca.eigenvectors;
+            fs << "pcaEigenvalues" << pca.eigenvalues;
+
+            fs << "wordCount" << wordCount;
+            fs << "nodes" << "[";
+            for (const Node& n : nodes) {
+                fs << "{" << "centers" << n.centers << "children" << n.children << "}";
+            }
+            fs << "]";
+
+            fs << "names" << names;
+
+            // Postings as one (word, image, count) row each.
+            size_t total = 0;
+            for (const std::vector<Posting>& list : postings) total += list.size();
+            cv::Mat flat(static_cast<int>(total), 3, CV_32S);
+            int row = 0;
+            for (int w = 0; w < wordCount; ++w) {
+                for (const Posting& p : postings[w]) {
+                    int* r = flat.ptr<int>(row++);
+                    r[0] = w;
+                    r[1] = p.image;
+                    r[2] = p.count;
+                }
+            }
+            fs << "postings" << flat;
+        }
+        catch (const cv::Exception& e) {
+            std::cerr << "RetrievalIndex::save: " << e.what() << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    bool RetrievalIndex::load(const std::string& path)
+    {
+        try {
+            cv::FileStorage fs(path, cv::FileStorage::READ);
+            if (!fs.isOpened()) {
+                std::cerr << "RetrievalIndex::load: could not open " << path << "\n";
+                return false;
+            }
+
+            SLSOptions o;
+            fs["sigma"] >> o.sigma;
+            fs["gridSpacing"] >> o.gridSpacing;
+            fs["dimReduction"] >> o.dimReduction;
+            fs["dimReductionCov"] >> o.dimReductionCov;
+            fs["subsDim"] >> o.subsDim;
+            fs["octaveSigma"] >> o.octaveSigma;
+
+            cv::PCA p;
+            fs["pcaMean"] >> p.mean;
+            fs["pcaEigenvectors"] >> p.eigenvectors;
+            fs["pcaEigenvalues"] >> p.eigenvalues;
+
+            int words = 0;
+            fs["wordCount"] >> words;
+            std::vector<Node> n;
+            cv::FileNode nn = fs["nodes"];
+            for (cv::FileNodeIterator it = nn.begin(); it != nn.end(); ++it) {
+                Node node;
+                (*it)["centers"] >> node.centers;
+                (*it)["children"] >> node.children;
+                n.push_back(node);
+            }
+
+            std::vector<std::string> refNames;
+            fs["names"] >> refNames;
+            cv::Mat flat;
+            fs["postings"] >> flat;
+
+            if (n.empty() || words <= 0 || p.eigenvectors.empty() || o.sigma.empty()) {
+                std::cerr << "RetrievalIndex::load: " << path << " is not a retrieval index.\n";
+                return false;
+            }
+
+            std::vector<std::vector<Posting> > lists(words);
+            for (int r = 0; r < flat.rows; ++r) {
+                const int* f = flat.ptr<int>(r);
+                if (f[0] < 0 || f[0] >= words || f[1] < 0 || f[1] >= static_cast<int>(refNames.size())) {
+                    std::cerr << "RetrievalIndex::load: corrupt posting in " << path << "\n";
+                    return false;
+                }
+                Posting post;
+                post.image = f[1];
+                post.count = f[2];
+                post.weight = 0.0f;
+                lists[f[0]].push_back(post);
+            }
+
+            opts = o;
+            pca = p;
+            nodes.swap(n);
+            wordCount = words;
+            idf.assign(words, 0.0f);
+            postings.swap(lists);
+            names.swap(refNames);
+        }
+        catch (const cv::Exception& e) {
+            std::cerr << "RetrievalIndex::load: failed to parse " << path << ": " << e.what() << "\n";
+            return false;
+        }
+
+        finalize();
+        return true;
+    }
+}
@@ -0,0 +1,494 @@
+#include "sls/shard.hpp"
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/core/utils/filesystem.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#include <process.h>
+#include <sys/utime.h>
+#else
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+namespace sls {
+
+    namespace {
+
+        const char* const kPending = "pending";
+        const char* const kClaimed = "claimed";
+        const char* const kDone = "done";
+        const char* const kFailed = "failed";
+
+        struct WorkUnit {
+            int                    attempts;
+            std::vector<PairEntry> pairs;
+            std::vector<std::string> notes;   // '#' lines other than the attempt count
+        };
+
+        std::string joinPath(const std::string& dir, const std::string& file)
+        {
+            if (dir.empty()) return file;
+            char last = dir[dir.size() - 1];
+            if (last == '/' || last == '\\') return dir + file;
+            return dir + "/" + file;
+        }
+
+        std::string baseName(const std::string& path)
+        {
+            size_t slash = path.find_last_of("/\\");
+            return slash == std::string::npos ? path : path.substr(slash + 1);
+        }
+
+        std::vector<std::string> listFiles(const std::string& dir, const std::string& pattern)
+        {
+            std::vector<std::string> files;
+            if (!cv::utils::fs::isDirectory(dir)) return files;
+            cv::glob(joinPath(dir, pattern), files, false);
+            return files;
+        }
+
+        // Seconds since the file was last modified, -1 if it is gone.
+        double fileAgeSeconds(const std::string& path)
+        {
+#if defined(_WIN32)
+            struct _stat64 st;
+            if (_stat64(path.c_str(), &st) != 0) return -1.0;
+#else
+            struct stat st;
+            if (stat(path.c_str(), &st) != 0) return -1.0;
+#endif
+            return std::difftime(std::time(nullptr), st.st_mtime);
+        }
+
+        // Write next to the destination, then rename, so readers never see
+        // a partial file.
+        bool writeFileAtomically(const std::string& path, const std::string& content, const std::string& tag)
+        {
+            const std::string tmp = path + ".tmp." + tag;
+            {
+                std::ofstream out(tmp, std::ios::binary);
+                if (!out) return false;
+                out << content;
+                if (!out) return false;
+            }
+#if defined(_WIN32)
+            std::remove(path.c_str());   // rename does not replace on Windows
+#endif
+            if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+                std::remove(tmp.c_str());
+                return false;
+            }
+            return true;
+        }
+
+        bool readUnit(const std::string& path, WorkUnit& unit)
+        {
+            std::ifstream in(path);
+            if (!in) return false;
+
+            unit.attempts = 0;
+            unit.pairs.clear();
+            unit.notes.clear();
+            std::string line;
+            while (std::getline(in, line)) {
+                if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+                if (line.empty()) continue;
+                if (line[0] == '#') {
+                    if (line.compare(0, 11, "# attempts ") == 0) unit.attempts = std::atoi(line.c_str() + 11);
+                    else unit.notes.push_back(line);
+                    continue;
+                }
+                std::istringstream ss(line);
+                PairEntry e;
+                if (ss >> e.source >> e.target >> e.name) unit.pairs.push_back(e);
+            }
+            return true;
+        }
+
+        std::string formatUnit(const WorkUnit& unit)
+        {
+            std::ostringstream os;
+            os << "# attempts " << unit.attempts << "\n";
+            for (const std::string& note : unit.notes) os << note << "\n";
+            for (const PairEntry& p : unit.pairs) {
+                os << p.source << ' ' << p.target << ' ' << p.name << "\n";
+            }
+            return os.str();
+        }
+
+        // Append a line to a claimed unit. Never creates the file: once the
+        // claim has been requeued it is gone, and recreating it would leave a
+        // phantom claim behind. Returns false in that case.
+        bool appendNote(const std::string& path, const std::string& note)
+        {
+            std::FILE* f = std::fopen(path.c_str(), "r+");
+            if (!f) return false;
+            bool ok = std::fseek(f, 0, SEEK_END) == 0 && std::fputs((note + "\n").c_str(), f) >= 0;
+            return std::fclose(f) == 0 && ok;
+        }
+
+        // Refresh the modification time requeueStaleUnits looks at, if the
+        // claim still exists.
+        bool touchClaim(const std::string& path)
+        {
+#if defined(_WIN32)
+            struct _stat64 st;
+            if (_stat64(path.c_str(), &st) != 0) return false;
+            return _utime(path.c_str(), nullptr) == 0;
+#else
+            struct stat st;
+            if (stat(path.c_str(), &st) != 0) return false;
+            return utime(path.c_str(), nullptr) == 0;
+#endif
+        }
+
+        // Keeps a claim's lease alive while its unit is processed; a single
+        // pair can take longer than the lease. Notices when the claim is
+        // gone (the lease ran out anyway and the unit was requeued).
+        class ClaimHeartbeat {
+        public:
+            ClaimHeartbeat(const std::string& path, int leaseSeconds)
+                : claimPath(path), lost(false), stopping(false)
+            {
+                // Three beats per lease so one late beat does not expire it.
+                const int64_t intervalMs = std::max<int64_t>(100, int64_t(leaseSeconds) * 1000 / 3);
+                worker = std::thread([this, intervalMs]() {
+                    std::unique_lock<std::mutex> lock(mtx);
+                    while (!cv.wait_for(lock, std::chrono::milliseconds(intervalMs), [this]() { return stopping; })) {
+                        if (!touchClaim(claimPath)) {
+                            lost = true;
+                            return;
+                        }
+                    }
+                });
+            }
+
+            ~ClaimHeartbeat() { stop(); }
+
+            void stop()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    stopping = true;
+                }
+                cv.notify_all();
+                if (worker.joinable()) worker.join();
+            }
+
+            bool claimLost() const { return lost; }
+            void markLost() { lost = true; }
+
+        private:
+            std::string             claimPath;
+            std::atomic<bool>       lost;
+            bool                    stopping;
+            std::mutex              mtx;
+            std::condition_variable cv;
+            std::thread             worker;
+        };
+
+        // Lease and attempt limit are properties of the queue, stored by
+        // createWorkQueue, so every worker and coordinator agrees on them.
+        // Queues without queue.yml keep the caller's values.
+        ShardParams queueParams(const std::string& queueDir, const ShardParams& params)
+        {
+            ShardParams p = params;
+            const std::string path = joinPath(queueDir, "queue.yml");
+            if (!cv::utils::fs::exists(path)) return p;
+            cv::FileStorage fs(path, cv::FileStorage::READ);
+            if (!fs.isOpened()) return p;
+            if (!fs["leaseSeconds"].empty()) p.leaseSeconds = std::max(1, static_cast<int>(fs["leaseSeconds"]));
+            if (!fs["maxAttempts"].empty()) p.maxAttempts = std::max(1, static_cast<int>(fs["maxAttempts"]));
+            return p;
+        }
+
+        std::string formatQueueParams(const ShardParams& params)
+        {
+            cv::FileStorage fs(".yml", cv::FileStorage::WRITE | cv::FileStorage::MEMORY);
+            fs << "unitSize" << params.unitSize;
+            fs << "leaseSeconds" << params.leaseSeconds;
+            fs << "maxAttempts" << params.maxAttempts;
+            return fs.releaseAndGetString();
+        }
+
+        // Put a unit whose attempt failed back in pending/, or in failed/
+        // once it has used up its attempts.
+        void retireAttempt(const std::string& queueDir, const std::string& unitName,
+            WorkUnit& unit, const ShardParams& params, const std::string& tag)
+        {
+            ++unit.attempts;
+            const bool giveUp = unit.attempts >= params.maxAttempts;
+            const std::string dst = joinPath(joinPath(queueDir, giveUp ? kFailed : kPending), unitName);
+            if (!writeFileAtomically(dst, formatUnit(unit), tag)) {
+                std::cerr << "shard: could not write " << dst << "\n";
+                return;
+            }
+            std::cout << "[SHARD] " << unitName << (giveUp ? " failed after " : " requeued after attempt ")
+                << unit.attempts << (giveUp ? " attempts." : ".") << std::endl;
+        }
+
+        bool claimUnit(const std::string& queueDir, const std::string& workerId,
+            std::string& claimedPath, std::string& unitName)
+        {
+            std::vector<std::string> pending = listFiles(joinPath(queueDir, kPending), "*.unit");
+            if (pending.empty()) return false;
+
+            // Start at a worker-specific offset so workers do not all race
+            // for the same file.
+            const size_t n = pending.size();
+            const size_t start = std::hash<std::string>()(workerId) % n;
+            for (size_t k = 0; k < n; ++k) {
+                const std::string& src = pending[(start + k) % n];
+                const std::string name = baseName(src);
+                const std::string dst = joinPath(joinPath(queueDir, kClaimed), name + "." + workerId);
+                if (std::rename(src.c_str(), dst.c_str()) == 0) {
+                    claimedPath = dst;
+                    unitName = name;
+                    return true;
+                }
+            }
+            return false;
+        }
+    }
+
+    std::string defaultWorkerId()
+    {
+        std::string host;
+#if defined(_WIN32)
+        const char* env = std::getenv("COMPUTERNAME");
+        if (env) host = env;
+        const int pid = _getpid();
+#else
+        char buf[256] = { 0 };
+        if (gethostname(buf, sizeof(buf) - 1) == 0) host = buf;
+        const int pid = static_cast<int>(getpid());
+#endif
+        if (host.empty()) host = "host";
+        // Keep the id usable as a file name suffix.
+        for (char& c : host) {
+            if (c == '/' || c == '\\' || c == ' ' || c == '.') c = '_';
+        }
+        return host + "-" + std::to_string(pid);
+    }
+
+    int createWorkQueue(const std::string& queueDir,
+        const std::vector<PairEntry>& pairs,
+        const std::string& optionsText,
+        const ShardParams& params)
+    {
+        CV_Assert(params.unitSize >= 1);
+
+        QueueStatus st = queueStatus(queueDir);
+        if (st.pending + st.claimed + st.done + st.failed > 0) {
+            std::cout << "[SHARD] Resuming existing queue in " << queueDir << ": "
+                << st.pending << " pending, " << st.claimed << " claimed, "
+                << st.done << " done, " << st.failed << " failed." << std::endl;
+            return 0;
+        }
+
+        const char* const dirs[] = { kPending, kClaimed, kDone, kFailed };
+        for (const char* d : dirs) {
+            if (!cv::utils::fs::createDirectories(joinPath(queueDir, d))) {
+                std::cerr << "createWorkQueue: could not create " << joinPath(queueDir, d) << "\n";
+                return -1;
+            }
+        }
+
+        if (!writeFileAtomically(joinPath(queueDir, "queue.yml"), formatQueueParams(params), "coordinator")) {
+            std::cerr << "createWorkQueue: could not write " << joinPath(queueDir, "queue.yml") << "\n";
+            return -1;
+        }
+        if (!optionsText.empty()
+            && !writeFileAtomically(joinPath(queueDir, "options.yml"), optionsText, "coordinator")) {
+            std::cerr << "createWorkQueue: could not write options to " << queueDir << "\n";
+            return -1;
+        }
+
+        int units = 0;
+        for (size_t start = 0; start < pairs.size(); start += params.unitSize) {
+            WorkUnit unit;
+            unit.attempts = 0;
+            const size_t end = std::min(pairs.size(), start + params.unitSize);
+            unit.pairs.assign(pairs.begin() + start, pairs.begin() + end);
+
+            char name[32];
+            std::snprintf(name, sizeof(name), "unit_%06d.unit", units);
+            // Written outside pending/ first so no worker claims a partial unit.
+            const std::string tmp = joinPath(queueDir, name);
+            if (!writeFileAtomically(tmp, formatUnit(unit), "coordinator")
+                || std::rename(tmp.c_str(), joinPath(joinPath(queueDir, kPending), name).c_str()) != 0) {
+                std::cerr << "createWorkQueue: could not queue " << name << "\n";
+                return -1;
+            }
+            ++units;
+        }
+
+        std::cout << "[SHARD] Queued " << pairs.size() << " pairs as " << units
+            << " units in " << queueDir << std::endl;
+        return units;
+    }
+
+    QueueStatus queueStatus(const std::string& queueDir)
+    {
+        QueueStatus st;
+        st.pending = static_cast<int>(listFiles(joinPath(queueDir, kPending), "*.unit").size());
+        st.claimed = static_cast<int>(listFiles(joinPath(queueDir, kClaimed), "*.unit.*").size());
+        st.done = static_cast<int>(listFiles(joinPath(queueDir, kDone), "*.unit").size());
+        st.failed = static_cast<int>(listFiles(joinPath(queueDir, kFailed), "*.unit").size());
+        return st;
+    }
+
+    int requeueStaleUnits(const std::string& queueDir, const ShardParams& callerParams)
+    {
+        const ShardParams params = queueParams(queueDir, callerParams);
+        const std::string tag = params.workerId.empty() ? defaultWorkerId() : params.workerId;
+        int moved = 0;
+
+        for (const std::string& path : listFiles(joinPath(queueDir, kClaimed), "*.unit.*")) {
+            double age = fileAgeSeconds(path);
+            if (age < params.leaseSeconds) continue;
+
+            // Take the stale claim out of claimed/ first; only one of several
+            // workers or coordinators doing this at once succeeds.
+            const std::string name = baseName(path);
+            const std::string unitName = name.substr(0, name.find(".unit") + 5);
+            const std::string taken = joinPath(queueDir, name + ".requeue." + tag);
+            if (std::rename(path.c_str(), taken.c_str()) != 0) continue;
+
+            WorkUnit unit;
+            if (readUnit(taken, unit)) {
+                unit.notes.push_back("# lease expired: " + name);
+                retireAttempt(queueDir, unitName, unit, params, tag);
+                ++moved;
+            }
+            std::remove(taken.c_str());
+        }
+        return moved;
+    }
+
+    int runShardWorker(const std::string& queueDir,
+        const BatchOptions& opts,
+        const std::string& outDir,
+        const ShardParams& callerParams)
+    {
+        const std::string workerId = callerParams.workerId.empty() ? defaultWorkerId() : callerParams.workerId;
+        if (!cv::utils::fs::isDirectory(joinPath(queueDir, kPending))) {
+            std::cerr << "runShardWorker: " << queueDir << " is not a work queue\n";
+            return 0;
+        }
+        const ShardParams params = queueParams(queueDir, callerParams);
+        cv::utils::fs::createDirectories(outDir);
+
+        const std::string timingPath = joinPath(outDir, "timing." + workerId + ".jsonl");
+        std::ofstream timing(timingPath, std::ios::app);
+        if (!timing) {
+            std::cerr << "runShardWorker: could not write " << timingPath << "\n";
+            return 0;
+        }
+
+        int completed = 0;
+        for (;;) {
+            std::string claimedPath, unitName;
+            if (!claimUnit(queueDir, workerId, claimedPath, unitName)) {
+                requeueStaleUnits(queueDir, params);
+                QueueStatus st = queueStatus(queueDir);
+                if (st.pending == 0 && st.claimed == 0) break;
+                if (st.pending == 0) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(params.pollMs));
+                }
+                continue;
+            }
+
+            WorkUnit unit;
+            if (!readUnit(claimedPath, unit)) {
+                std::cerr << "runShardWorker: could not read " << claimedPath << "\n";
+                continue;
+            }
+            std::cout << "[SHARD] " << workerId << ": " << unitName << " ("
+                << unit.pairs.size() << " pairs, attempt " << (unit.attempts + 1) << ")" << std::endl;
+
+            ClaimHeartbeat heartbeat(claimedPath, params.leaseSeconds);
+            int failed = 0;
+            for (const PairEntry& pair : unit.pairs) {
+                if (heartbeat.claimLost()) break;
+
+                // Checkpoint from an earlier attempt or an interrupted run.
+                const std::string marker = joinPath(outDir, pair.name + ".done");
+                if (cv::utils::fs::exists(marker)) continue;
+
+                PairResult res = processPair(pair, opts, outDir);
+                std::ostringstream line;
+                writeTimingJson(line, pair, res);
+                timing << line.str();
+                timing.flush();
+
+                bool held;
+                if (res.ok) {
+                    if (!writeFileAtomically(marker, line.str(), workerId)) {
+                        std::cerr << "runShardWorker: could not write " << marker << "\n";
+                    }
+                    held = appendNote(claimedPath, "# done " + pair.name);
+                }
+                else {
+                    ++failed;
+                    std::cerr << "shard: " << pair.name << ": " << res.error << "\n";
+                    held = appendNote(claimedPath, "# error " + pair.name + ": " + res.error);
+                }
+                if (!held) heartbeat.markLost();
+            }
+            heartbeat.stop();
+
+            if (heartbeat.claimLost()) {
+                // The lease ran out and someone requeued the unit; whoever
+                // claims it next skips the checkpointed pairs.
+                std::cerr << "shard: lost the claim on " << unitName << "\n";
+                continue;
+            }
+
+            if (failed == 0) {
+                const std::string dst = joinPath(joinPath(queueDir, kDone), unitName);
+                if (std::rename(claimedPath.c_str(), dst.c_str()) == 0) {
+                    ++completed;
+                }
+                else {
+                    std::cerr << "shard: lost the claim on " << unitName << "\n";
+                }
+            }
+            else {
+                // Take the claim over under a name that still counts as
+                // claimed, so the unit is never invisible to workers checking
+                // whether the queue is drained, and the rename fails if the
+                // claim was requeued in the meantime.
+                const std::string retiring = claimedPath + ".retiring";
+                WorkUnit latest;
+                if (std::rename(claimedPath.c_str(), retiring.c_str()) != 0) {
+                    std::cerr << "shard: lost the claim on " << unitName << "\n";
+                }
+                else if (readUnit(retiring, latest)) {
+                    unit.notes = latest.notes;
+                    retireAttempt(queueDir, unitName, unit, params, workerId);
+                    std::remove(retiring.c_str());
+                }
+            }
+        }
+
+        std::cout << "[SHARD] " << workerId << ": queue drained, completed "
+            << completed << " unit(s)." << std::endl;
+        return completed;
+    }
+}
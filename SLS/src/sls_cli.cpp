@@ -0,0 +1,983 @@
+// Command-line front end for the SLS library.
+// Subcommands:
+//   batch - headless processing of a manifest of image pairs
+//   eval  - synthetic homography accuracy vs. throughput evaluation
+//   serve - resident extraction service on a local socket
+//   query - client for `serve`
+//   index - build a retrieval index over reference images
+//   search - ranked reference shortlist for query images
+//   plan  - predicted memory per stage and recommended banding
+//   progressive - coarse-to-fine extraction timings for one pair
+//   shard - split a manifest into a shared-directory work queue
+//   worker - process units from a work queue
+//   cache - inspect, trim or clear a descriptor cache directory
+#include <opencv2/opencv.hpp>
+#include <opencv2/core/utils/filesystem.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sls/sls_options.hpp"
+#include "sls/sls_extractor.hpp"
+#include "sls/eval_harness.hpp"
+#include "sls/batch.hpp"
+#include "sls/extraction_service.hpp"
+#include "sls/ingest.hpp"
+#include "sls/retrieval.hpp"
+#include "sls/memory_plan.hpp"
+#include "sls/progressive.hpp"
+#include "sls/shard.hpp"
+#include "sls/descriptor_cache.hpp"
+
+using namespace cv;
+using std::cout;
+using std::endl;
+
+static void printUsage()
+{
+    std::cerr <<
+        "usage: sls_cli <command> [options]\n"
+        "\n"
+        "commands:\n"
+        "  batch --manifest FILE [--options FILE] [--out DIR] [--timing FILE|-]\n"
+        "      Process every 'source target [name]' line of the manifest with the\n"
+        "      options file settings and write descriptors, flow and matches to DIR.\n"
+        "      Per-pair timings are written as JSON lines (default DIR/timing.jsonl;\n"
+        "      with '-' they go to stdout and all log output to stderr).\n"
+        "  eval [--pairs N] [--seed S] [--scale F] [--step N] [--csv FILE] image...\n"
+        "      Warp each image with random homographies and report flow accuracy\n"
+        "      and throughput for the built-in extractor/flow configurations.\n"
+        "  serve --socket PATH [--max-batch N] [--batch-wait-ms N] [--max-warm N]\n"
+        "      Run the resident extraction service on a Unix-domain socket.\n"
+        "  query --socket PATH [--options FILE] [--out DIR] [--repeat N] source target\n"
+        "      Send a pair to a running service and report latency.\n"
+        "  index --out FILE [--options FILE] [--list FILE] [--scale F] [--branching N]\n"
+        "        [--levels N] [--train-images N] image...\n"
+        "      Train a vocabulary tree on the reference images and store them in a\n"
+        "      tf-idf inverted index.\n"
+        "  search --index FILE [--scale F] [--top N] query...\n"
+        "      Print the best matching references per query (use the same --scale\n"
+        "      as for index).\n"
+        "  plan [--options FILE] [--budget-mb N] [--threads N] [--subspace] size1 [size2]\n"
+        "      Predict peak memory per stage for a pair of images (WxH at original\n"
+        "      resolution, or image paths) and recommend a band size and thread count\n"
+        "      that fit the budget.\n"
+        "  progressive [--options FILE] [--cancel-after-ms N] source target\n"
+        "      Run coarse-to-fine extraction and print when each level arrives.\n"
+        "  shard --manifest FILE --queue DIR [--options FILE] [--unit-size N]\n"
+        "        [--lease-sec N] [--max-attempts N] [--wait]\n"
+        "      Split the manifest into work units under DIR (or resume an existing\n"
+        "      queue). With --wait, monitor until drained, requeueing expired claims.\n"
+        "      --lease-sec and --max-attempts are stored with a new queue.\n"
+        "  worker --queue DIR [--options FILE] [--out DIR] [--id NAME]\n"
+        "      Claim and process units until the queue is drained. Start any number\n"
+        "      of workers, on one or several machines sharing DIR.\n"
+        "  cache [--dir DIR] [--max-mb N] [--trim] [--clear]\n"
+        "      Show the size of a descriptor cache (default $SLS_CACHE_DIR), evict\n"
+        "      down to --max-mb, or empty it. Setting SLS_CACHE_DIR (and SLS_CACHE_MB)\n"
+        "      makes every command reuse cached descriptors.\n";
+}
+
+// Built-in operating points compared by `eval`.
+static std::vector<sls::EvalConfig> defaultEvalConfigs()
+{
+    std::vector<sls::EvalConfig> configs;
+
+    sls::EvalConfig dsift;
+    dsift.name = "dsift-g8-local";
+    dsift.opts = makeSLSOptions(false);
+    dsift.useSLS = false;
+    configs.push_back(dsift);
+
+    sls::EvalConfig slsLocal;
+    slsLocal.name = "sls-g8-local";
+    slsLocal.opts = makeSLSOptions(false);
+    configs.push_back(slsLocal);
+
+    sls::EvalConfig slsSgm = slsLocal;
+    slsSgm.name = "sls-g8-sgm";
+    slsSgm.regularize = true;
+    configs.push_back(slsSgm);
+
+    sls::EvalConfig slsFine = slsLocal;
+    slsFine.name = "sls-g4-local";
+    slsFine.opts.gridSpacing = 4;
+    slsFine.windowRadius = 10;
+    configs.push_back(slsFine);
+
+    return configs;
+}
+
+static int runBatch(int argc, char** argv)
+{
+    std::string manifestPath, optionsPath, timingPath;
+    std::string outDir = ".";
+
+    for (int i = 0; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--manifest" && hasValue) {
+            manifestPath = argv[++i];
+        }
+        else if (arg == "--options" && hasValue) {
+            optionsPath = argv[++i];
+        }
+        else if (arg == "--out" && hasValue) {
+            outDir = argv[++i];
+        }
+        else if (arg == "--timing" && hasValue) {
+            timingPath = argv[++i];
+        }
+        else {
+            std::cerr << "batch: unknown argument " << arg << "\n";
+            return 2;
+        }
+    }
+
+    if (manifestPath.empty()) {
+        printUsage();
+        return 2;
+    }
+
+    sls::BatchOptions opts;
+    if (!optionsPath.empty() && !sls::loadBatchOptions(optionsPath, opts)) {
+        return 2;
+    }
+
+    std::vector<sls::PairEntry> pairs;
+    if (!sls::loadPairManifest(manifestPath, pairs)) {
+        return 2;
+    }
+
+    utils::fs::createDirectories(outDir);
+    if (timingPath.empty()) {
+        timingPath = outDir + "/timing.jsonl";
+    }
+
+    // With "--timing -" stdout carries only the JSON lines; progress and
+    // library logs written to cout are rerouted to stderr meanwhile.
+    struct StdoutToStderr {
+        std::streambuf* saved;
+        StdoutToStderr() : saved(cout.rdbuf(std::cerr.rdbuf())) {}
+        ~StdoutToStderr() { cout.rdbuf(saved); }
+    };
+
+    std::ofstream timingFile;
+    std::ostream timingStdout(cout.rdbuf());
+    std::ostream* timing = &timingStdout;
+    std::unique_ptr<StdoutToStderr> logsToStderr;
+    if (timingPath != "-") {
+        timingFile.open(timingPath);
+        if (!timingFile) {
+            std::cerr << "batch: could not write " << timingPath << "\n";
+            return 1;
+        }
+        timing = &timingFile;
+    }
+    else {
+        logsToStderr.reset(new StdoutToStderr());
+    }
+
+    int failed = 0;
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        cout << "[BATCH] " << (i + 1) << " / " << pairs.size()
+            << ": " << pairs[i].name << endl;
+        sls::PairResult res = sls::processPair(pairs[i], opts, outDir);
+        if (!res.ok) {
+            std::cerr << "batch: " << pairs[i].name << ": " << res.error << "\n";
+            ++failed;
+        }
+        sls::writeTimingJson(*timing, pairs[i], res);
+        timing->flush();
+    }
+
+    cout << "[BATCH] Done: " << (pairs.size() - failed) << " succeeded, "
+        << failed << " failed." << endl;
+    return failed == 0 ? 0 : 1;
+}
+
+static int runEval(int argc, char** argv)
+{
+    sls::EvalParams params;
+    double scaleFactor = 0.25;
+    std::string csvPath;
+    std::vector<std::string> paths;
+
+    for (int i = 0; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--pairs" && hasValue) {
+            params.pairsPerImage = std::atoi(argv[++i]);
+        }
+        else if (arg == "--seed" && hasValue) {
+            params.seed = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--scale" && hasValue) {
+            scaleFactor = std::atof(argv[++i]);
+        }
+        else if (arg == "--step" && hasValue) {
+            params.evalStep = std::atoi(argv[++i]);
+        }
+        else if (arg == "--csv" && hasValue) {
+            csvPath = argv[++i];
+        }
+        else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "eval: unknown option " << arg << "\n";
+            return 2;
+        }
+        else {
+            paths.push_back(arg);
+        }
+    }
+
+    if (paths.empty()) {
+        printUsage();
+        return 2;
+    }
+
+    std::vector<Mat> images;
+    for (const std::string& path : paths) {
+        Mat img = imread(path, IMREAD_GRAYSCALE);
+        if (img.empty()) {
+            std::cerr << "eval: could not load " << path << "\n";
+            continue;
+        }
+        if (scaleFactor != 1.0) {
+            resize(img, img, Size(), scaleFactor, scaleFactor, INTER_AREA);
+        }
+        images.push_back(img);
+    }
+
+    std::vector<sls::EvalRecord> records =
+        sls::runSyntheticEval(images, defaultEvalConfigs(), params);
+    if (records.empty()) {
+        return 1;
+    }
+
+    cout << "\n";
+    sls::printEvalReport(cout, records);
+
+    if (!csvPath.empty()) {
+        std::ofstream csv(csvPath);
+        if (!csv) {
+            std::cerr << "eval: could not write " << csvPath << "\n";
+            return 1;
+        }
+        sls::writeEvalCsv(csv, records);
+        cout << "Saved CSV report to " << csvPath << endl;
+    }
+    return 0;
+}
+
+static bool readFileBytes(const std::string& path, std::vector<uchar>& out)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    out.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+}
+
+static int runServe(int argc, char** argv)
+{
+    sls::ServiceParams params;
+
+    for (int i = 0; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--socket" && hasValue) {
+            params.socketPath = argv[++i];
+        }
+        else if (arg == "--max-batch" && hasValue) {
+            params.maxBatch = std::atoi(argv[++i]);
+        }
+        else if (arg == "--batch-wait-ms" && hasValue) {
+            params.batchWaitMs = std::atoi(argv[++i]);
+        }
+        else if (arg == "--max-warm" && hasValue) {
+            params.maxWarm = std::atoi(argv[++i]);
+        }
+        else {
+            std::cerr << "serve: unknown argument " << arg << "\n";
+            return 2;
+        }
+    }
+
+    if (params.socketPath.empty()) {
+        printUsage();
+        return 2;
+    }
+
+    sls::ExtractionService service(params);
+    return service.run() ? 0 : 1;
+}
+
+static int runQuery(int argc, char** argv)
+{
+    std::string socketPath, optionsPath, outDir;
+    std::vector<std::string> paths;
+    int repeat = 1;
+
+    for (int i = 0; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--socket" && hasValue) {
+            socketPath = argv[++i];
+        }
+        else if (arg == "--options" && hasValue) {
+            optionsPath = argv[++i];
+        }
+        else if (arg == "--out" && hasValue) {
+            outDir = argv[++i];
+        }
+        else if (arg == "--repeat" && hasValue) {
+            repeat = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "query: unknown option " << arg << "\n";
+            return 2;
+        }
+        else {
+            paths.push_back(arg);
+        }
+    }
+
+    if (socketPath.empty() || paths.size() != 2) {
+        printUsage();
+        return 2;
+    }
+
+    sls::ServiceRequest req;
+    if (!optionsPath.empty()) {
+        std::vector<uchar> text;
+        if (!readFileBytes(optionsPath, text)) {
+            std::cerr << "query: could not read " << optionsPath << "\n";
+            return 2;
+        }
+        req.options.assign(text.begin(), text.end());
+    }
+    if (!readFileBytes(paths[0], req.image1) || !readFileBytes(paths[1], req.image2)) {
+        std::cerr << "query: could not read input images\n";
+        return 2;
+    }
+
+    sls::ServiceClient client;
+    if (!client.connect(socketPath)) {
+        std::cerr << "query: could not connect to " << socketPath << "\n";
+        return 1;
+    }
+
+    sls::ServiceReply reply;
+    for (int r = 0; r < repeat; ++r) {
+        TickMeter tm;
+        tm.start();
+        if (!client.request(req, reply)) {
+            std::cerr << "query: connection to service lost\n";
+            return 1;
+        }
+        tm.stop();
+
+        if (!reply.ok) {
+            std::cerr << "query: service error: " << reply.error << "\n";
+            return 1;
+        }
+        cout << "{\"round_trip_ms\":" << tm.getTimeMilli()
+            << ",\"server_ms\":" << reply.serverMs
+            << ",\"batch\":" << reply.batchSize
+            << ",\"points1\":" << reply.desc1.cols
+            << ",\"points2\":" << reply.desc2.cols
+            << ",\"dim\":" << reply.desc1.rows
+            << ",\"flow\":" << (reply.flow.empty() ? "false" : "true") << "}" << endl;
+    }
+
+    if (!outDir.empty()) {
+        utils::fs::createDirectories(outDir);
+        FileStorage fs(outDir + "/reply.desc.yml.gz", FileStorage::WRITE);
+        fs << "desc1" << reply.desc1 << "desc2" << reply.desc2;
+        fs << "grid1" << reply.grid1 << "grid2" << reply.grid2;
+        if (!reply.pcaBasis.empty()) fs << "pcaBasis" << reply.pcaBasis;
+        if (!reply.flow.empty()) {
+            writeOpticalFlow(outDir + "/reply.flo", reply.flow);
+        }
+    }
+    return 0;
+}
+
+static bool readPathList(const std::string& path, std::vector<std::string>& out)
+{
+    std::ifstream in(path);
+    if (!in) return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+        if (line.empty() || line[0] == '#') continue;
+        out.push_back(line);
+    }
+    return true;
+}
+
+// Describe paths[which[i]] in parallel; unreadable images stay empty.
+static void describeRange(const std::vector<std::string>& paths,
+    const std::vector<int>& which,
+    double scaleFactor,
+    const SLSOptions& opts,
+    std::vector<Mat>& descs)
+{
+    descs.assign(which.size(), Mat());
+    parallel_for_(Range(0, static_cast<int>(which.size())), [&](const Range& r) {
+        for (int i = r.start; i < r.end; ++i) {
+            Mat img = sls::loadGrayscale(paths[which[i]], scaleFactor);
+            if (!img.empty()) descs[i] = sls::describeImage(img, opts);
+        }
+    });
+}
+
+static int runIndex(int argc, char** argv)
+{
+    std::string outPath, optionsPath;
+    std::vector<std::string> paths;
+    double scaleFactor = 0.25;
+    int trainImages = 500;
+    sls::VocabularyParams vocab;
+
+    for (int i = 0; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--out" && hasValue) {
+            outPath = argv[++i];
+        }
+        else if (arg == "--options" && hasValue) {
+            optionsPath = argv[++i];
+        }
+        else if (arg == "--list" && hasValue) {
+            if (!readPathList(argv[++i], paths)) {
+                std::cerr << "index: could not read " << argv[i] << "\n";
+                return 2;
+            }
+        }
+        else if (arg == "--scale" && hasValue) {
+            scaleFactor = std::atof(argv[++i]);
+        }
+        else if (arg == "--branching" && hasValue) {
+            vocab.branching = std::atoi(argv[++i]);
+        }
+        else if (arg == "--levels" && hasValue) {
+            vocab.levels = std::atoi(argv[++i]);
+        }
+        else if (arg == "--train-images" && hasValue) {
+            trainImages = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "index: unknown option " << arg << "\n";
+            return 2;
+        }
+        else {
+            paths.push_back(arg);
+        }
+    }
+
+    if (outPath.empty() || paths.empty() || scaleFactor <= 0.0
+        || vocab.branching < 2 || vocab.levels < 1) {
+        printUsage();
+        return 2;
+    }
+
+    sls::BatchOptions batchOpts;
+    if (!optionsPath.empty() && !sls::loadBatchOptions(optionsPath, batchOpts)) {
+        return 2;
+    }
+    const SLSOptions& opts = batchOpts.sls;
+    const int N = static_cast<int>(paths.size());
+
+    // Train on an evenly spaced subset and keep those descriptors for indexing.
+    std::vector<int> trainIds;
+    const int numTrain = std::min(N, trainImages);
+    for (int t = 0; t < numTrain; ++t) {
+        trainIds.push_back(static_cast<int>(static_cast<long long>(t) * N / numTrain));
+    }
+
+    TickMeter tm;
+    tm.start();
+    cout << "[INDEX] Describing " << numTrain << " training images..." << endl;
+    std::vector<Mat> trainDescs;
+    describeRange(paths, trainIds, scaleFactor, opts, trainDescs);
+
+    sls::RetrievalIndex index;
+    if (!index.train(trainDescs, opts, vocab)) {
+        return 1;
+    }
+
+    std::vector<Mat> known(N);
+    for (size_t t = 0; t < trainIds.size(); ++t) known[trainIds[t]] = trainDescs[t];
+    trainDescs.clear();
+
+    const int chunk = 64;
+    int failed = 0;
+    for (int start = 0; start < N; start += chunk) {
+        std::vector<int> todo;
+        for (int i = start; i < std::min(N, start + chunk); ++i) {
+            if (known[i].empty()) todo.push_back(i);
+        }
+        std::vector<Mat> descs;
+        describeRange(paths, todo, scaleFactor, opts, descs);
+        for (size_t t = 0; t < todo.size(); ++t) known[todo[t]] = descs[t];
+
+        for (int i = start; i < std::min(N, start + chunk); ++i) {
+            if (known[i].empty()) {
+                std::cerr << "index: could not describe " << paths[i] << "\n";
+                ++failed;
+            }
+            else {
+                index.add(known[i], paths[i]);
+            }
+            known[i].release();
+        }
+        cout << "[INDEX] " << std::min(N, start + chunk) << " / " << N << endl;
+    }
+    index.finalize();
+    tm.stop();
+
+    if (!index.save(outPath)) {
+        return 1;
+    }
+    cout << "[INDEX] Indexed " << index.numImages() << " images (" << failed << " failed) with "
+        << index.numWords() << " words in " << tm.getTimeSec() << " s, saved to " << outPath << endl;
+    return 0;
+}
+
+static int runSearch(int argc, char** argv)
+{
+    std::string indexPath;
+    std::vector<std::string> paths;
+    double scaleFactor = 0.25;
+    int top = 10;
+
+    for (int i = 0; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--index" && hasValue) {
+            indexPath = argv[++i];
+        }
+        else if (arg == "--scale" && hasValue) {
+            scaleFactor = std::atof(argv[++i]);
+        }
+        else if (arg == "--top" && hasValue) {
+            top = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "search: unknown option " << arg << "\n";
+            return 2;
+        }
+        else {
+            paths.push_back(arg);
+        }
+    }
+
+    if (indexPath.empty() || paths.empty() || scaleFactor <= 0.0) {
+        printUsage();
+        return 2;
+    }
+
+    sls::RetrievalIndex index;
+    if (!index.load(indexPath)) {
+        return 1;
+    }
+
+    int failed = 0;
+    for (const std::string& path : paths) {
+        Mat img = sls::loadGrayscale(path, scaleFactor);
+        if (img.empty()) {
+            std::cerr << "search: could not load " << path << "\n";
+            ++failed;
+            continue;
+        }
+
+        TickMeter tm;
+        tm.start();
+        std::vector<sls::RetrievalHit> hits =
+            index.query(sls::describeImage(img, index.options()), top);
+        tm.stop();
+
+        // query <TAB> rank <TAB> score <TAB> reference
+        for (size_t r = 0; r < hits.size(); ++r) {
+            cout << path << '\t' << (r + 1) << '\t' << hits[r].score << '\t' << hits[r].name << "\n";
+        }
+        std::cerr << "[SEARCH] " << path << ": " << hits.size() << " hits in "
+            << tm.getTimeMilli() << " ms\n";
+    }
+    cout.flush();
+    return failed == 0 ? 0 : 1;
+}
+
+// "WxH" at original resolution, or an image path; returned at scaleFactor.
+static bool parseImageSize(const std::string& spec, double scaleFactor, Size& size)
+{
+    int w = 0, h = 0;
+    char x = 0;
+    std::istringstream ss(spec);
+    if ((ss >> w >> x >> h) && (x == 'x' || x == 'X') && ss.eof() && w > 0 && h > 0) {
+        size = Size(std::max(1, cvRound(w * scaleFactor)), std::max(1, cvRound(h * scaleFactor)));
+        return true;
+    }
+    Mat img = sls::loadGrayscale(spec, scaleFactor);
+    if (img.empty()) return false;
+    size = img.size();
+    return true;
+}
+
+static int runPlan(int argc, char** argv)
+{
+    std::string optionsPath;
+    std::vector<std::string> specs;
+    sls::MemoryPlanParams params;
+    int budgetMB = -1;
+
+    for (int i = 0; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--options" && hasValue) {
+            optionsPath = argv[++i];
+        }
+        else if (arg == "--budget-mb" && hasValue) {
+            budgetMB = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (arg == "--threads" && hasValue) {
+            params.maxThreads = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--subspace") {
+            params.subspace = true;
+        }
+        else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "plan: unknown option " << arg << "\n";
+            return 2;
+        }
+        else {
+            specs.push_back(arg);
+        }
+    }
+
+    if (specs.empty() || specs.size() > 2) {
+        printUsage();
+        return 2;
+    }
+
+    sls::BatchOptions opts;
+    if (!optionsPath.empty() && !sls::loadBatchOptions(optionsPath, opts)) {
+        return 2;
+    }
+    if (budgetMB < 0) budgetMB = opts.memoryBudgetMB;
+    params.budgetBytes = static_cast<size_t>(budgetMB) * 1024 * 1024;
+
+    Size size1, size2;
+    if (!parseImageSize(specs[0], opts.scaleFactor, size1)
+        || !parseImageSize(specs.back(), opts.scaleFactor, size2)) {
+        std::cerr << "plan: expected WxH or a readable image\n";
+        return 2;
+    }
+
+    SLSOptions sls = opts.sls;
+    if (!opts.useSLS) sls.dimReduction = 0;
+    sls::MemoryPlan plan = sls::planMemory(sls, size1, size2, params);
+    cout << "Images (scaled): " << size1.width << " x " << size1.height << ", "
+        << size2.width << " x " << size2.height << "\n";
+    sls::printMemoryPlan(cout, plan);
+    return plan.fits ? 0 : 1;
+}
+
+static int runProgressive(int argc, char** argv)
+{
+    std::string optionsPath;
+    std::vector<std::string> paths;
+    int cancelAfterMs = 0;
+
+    for (int i = 0; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--options" && hasValue) {
+            optionsPath = argv[++i];
+        }
+        else if (arg == "--cancel-after-ms" && hasValue) {
+            cancelAfterMs = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "progressive: unknown option " << arg << "\n";
+            return 2;
+        }
+        else {
+            paths.push_back(arg);
+        }
+    }
+
+    if (paths.size() != 2) {
+        printUsage();
+        return 2;
+    }
+
+    sls::BatchOptions opts;
+    if (!optionsPath.empty() && !sls::loadBatchOptions(optionsPath, opts)) {
+        return 2;
+    }
+    Mat I1 = sls::loadGrayscale(paths[0], opts.scaleFactor);
+    Mat I2 = sls::loadGrayscale(paths[1], opts.scaleFactor);
+    if (I1.empty() || I2.empty()) {
+        std::cerr << "progressive: could not load input images\n";
+        return 2;
+    }
+
+    sls::ProgressiveExtractor extractor(I1, I2, opts.sls, sls::ProgressiveParams(),
+        [](const sls::ProgressiveResult& r) {
+            cout << "{\"level\":" << r.level
+                << ",\"ms\":" << r.elapsedMs
+                << ",\"gridSpacing\":" << r.opts.gridSpacing
+                << ",\"scales\":" << r.opts.sigma.size()
+                << ",\"points1\":" << r.output.desc1.cols
+                << ",\"points2\":" << r.output.desc2.cols
+                << ",\"final\":" << (r.final ? "true" : "false") << "}" << endl;
+        });
+
+    std::shared_future<sls::ProgressiveResult> result = extractor.finalResult();
+    if (cancelAfterMs > 0
+        && result.wait_for(std::chrono::milliseconds(cancelAfterMs)) != std::future_status::ready) {
+        extractor.cancel();
+        cout << "[PROGRESSIVE] Cancelled after " << cancelAfterMs << " ms." << endl;
+    }
+    return result.get().level >= 0 ? 0 : 1;
+}
+
+static int runShard(int argc, char** argv)
+{
+    std::string manifestPath, queueDir, optionsPath;
+    sls::ShardParams params;
+    bool wait = false;
+
+    for (int i = 0; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--manifest" && hasValue) {
+            manifestPath = argv[++i];
+        }
+        else if (arg == "--queue" && hasValue) {
+            queueDir = argv[++i];
+        }
+        else if (arg == "--options" && hasValue) {
+            optionsPath = argv[++i];
+        }
+        else if (arg == "--unit-size" && hasValue) {
+            params.unitSize = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--lease-sec" && hasValue) {
+            params.leaseSeconds = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--max-attempts" && hasValue) {
+            params.maxAttempts = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--wait") {
+            wait = true;
+        }
+        else {
+            std::cerr << "shard: unknown argument " << arg << "\n";
+            return 2;
+        }
+    }
+
+    if (manifestPath.empty() || queueDir.empty()) {
+        printUsage();
+        return 2;
+    }
+
+    std::string optionsText;
+    if (!optionsPath.empty()) {
+        // Validate here so workers do not all fail on a bad file.
+        sls::BatchOptions check;
+        std::vector<uchar> text;
+        if (!sls::loadBatchOptions(optionsPath, check) || !readFileBytes(optionsPath, text)) {
+            return 2;
+        }
+        optionsText.assign(text.begin(), text.end());
+    }
+
+    std::vector<sls::PairEntry> pairs;
+    if (!sls::loadPairManifest(manifestPath, pairs)) {
+        return 2;
+    }
+    if (sls::createWorkQueue(queueDir, pairs, optionsText, params) < 0) {
+        return 1;
+    }
+    if (!wait) {
+        return 0;
+    }
+
+    params.workerId = "coordinator";
+    int lastPending = -1, lastClaimed = -1, lastDone = -1, lastFailed = -1;
+    for (;;) {
+        sls::requeueStaleUnits(queueDir, params);
+        sls::QueueStatus st = sls::queueStatus(queueDir);
+        if (st.pending != lastPending || st.claimed != lastClaimed
+            || st.done != lastDone || st.failed != lastFailed) {
+            cout << "[SHARD] pending " << st.pending << ", claimed " << st.claimed
+                << ", done " << st.done << ", failed " << st.failed << endl;
+            lastPending = st.pending;
+            lastClaimed = st.claimed;
+            lastDone = st.done;
+            lastFailed = st.failed;
+        }
+        if (st.pending == 0 && st.claimed == 0) {
+            return st.failed == 0 ? 0 : 1;
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+}
+
+static int runWorker(int argc, char** argv)
+{
+    std::string queueDir, optionsPath, outDir;
+    sls::ShardParams params;
+
+    for (int i = 0; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--queue" && hasValue) {
+            queueDir = argv[++i];
+        }
+        else if (arg == "--options" && hasValue) {
+            optionsPath = argv[++i];
+        }
+        else if (arg == "--out" && hasValue) {
+            outDir = argv[++i];
+        }
+        else if (arg == "--id" && hasValue) {
+            params.workerId = argv[++i];
+        }
+        else {
+            std::cerr << "worker: unknown argument " << arg << "\n";
+            return 2;
+        }
+    }
+
+    if (queueDir.empty()) {
+        printUsage();
+        return 2;
+    }
+    if (outDir.empty()) {
+        outDir = queueDir + "/out";
+    }
+    // Default to the options the coordinator stored with the queue.
+    if (optionsPath.empty() && utils::fs::exists(queueDir + "/options.yml")) {
+        optionsPath = queueDir + "/options.yml";
+    }
+
+    sls::BatchOptions opts;
+    if (!optionsPath.empty() && !sls::loadBatchOptions(optionsPath, opts)) {
+        return 2;
+    }
+
+    sls::runShardWorker(queueDir, opts, outDir, params);
+    return sls::queueStatus(queueDir).failed == 0 ? 0 : 1;
+}
+
+static int runCache(int argc, char** argv)
+{
+    sls::CacheParams params;
+    bool trim = false;
+    bool clear = false;
+
+    const char* envDir = std::getenv("SLS_CACHE_DIR");
+    if (envDir) params.dir = envDir;
+    const char* envMB = std::getenv("SLS_CACHE_MB");
+    if (envMB && std::atoi(envMB) > 0) params.maxBytes = static_cast<int64_t>(std::atoi(envMB)) << 20;
+
+    for (int i = 0; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--dir" && hasValue) {
+            params.dir = argv[++i];
+        }
+        else if (arg == "--max-mb" && hasValue) {
+            params.maxBytes = static_cast<int64_t>(std::max(1, std::atoi(argv[++i]))) << 20;
+        }
+        else if (arg == "--trim") {
+            trim = true;
+        }
+        else if (arg == "--clear") {
+            clear = true;
+        }
+        else {
+            std::cerr << "cache: unknown argument " << arg << "\n";
+            return 2;
+        }
+    }
+
+    if (params.dir.empty()) {
+        printUsage();
+        return 2;
+    }
+    if (!utils::fs::isDirectory(params.dir)) {
+        std::cerr << "cache: " << params.dir << " is not a directory\n";
+        return 2;
+    }
+
+    sls::DescriptorCache cache(params);
+    if (clear) cache.clear();
+    else if (trim) cache.trim();
+
+    sls::CacheStats st = cache.stats();
+    cout << "{\"dir\":\"" << params.dir << "\",\"entries\":" << st.entries
+        << ",\"mb\":" << (st.bytes / 1048576.0)
+        << ",\"limitMb\":" << (params.maxBytes >> 20)
+        << ",\"evicted\":" << st.evictions << "}" << endl;
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        printUsage();
+        return 2;
+    }
+
+    std::string command = argv[1];
+    if (command == "batch") {
+        return runBatch(argc - 2, argv + 2);
+    }
+    if (command == "eval") {
+        return runEval(argc - 2, argv + 2);
+    }
+    if (command == "serve") {
+        return runServe(argc - 2, argv + 2);
+    }
+    if (command == "query") {
+        return runQuery(argc - 2, argv + 2);
+    }
+    if (command == "index") {
+        return runIndex(argc - 2, argv + 2);
+    }
+    if (command == "search") {
+        return runSearch(argc - 2, argv + 2);
+    }
+    if (command == "plan") {
+        return runPlan(argc - 2, argv + 2);
+    }
+    if (command == "progressive") {
+        return runProgressive(argc - 2, argv + 2);
+    }
+    if (command == "shard") {
+        return runShard(argc - 2, argv + 2);
+    }
+    if (command == "worker") {
+        return runWorker(argc - 2, argv + 2);
+    }
+    if (command == "cache") {
+        return runCache(argc - 2, argv + 2);
+    }
+
+    std::cerr << "unknown command: " << command << "\n";
+    printUsage();
+    return 2;
+}
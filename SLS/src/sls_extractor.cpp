@@ -1,6 +1,7 @@
 #include "sls/sls_extractor.hpp"
 #include "sls/sls_options.hpp"
 #include "sls/dense_sift.hpp"
+#include "sls/descriptor_cache.hpp"
 
 #include <opencv2/opencv.hpp>
 #include <iostream>
@@ -56,45 +57,9 @@ static void pcaReduce(const Mat& dp1,
 }
 
 
-// Average descriptors across scales for each pixel.
-// dp: D x (numPoints * numSigma), column layout: si + i * numSigma
-// Returns: D x numPoints matrix (one descriptor per pixel).
-static Mat averageAcrossScales(const Mat& dp,
-    int numPoints,
-    int numSigma)
+// Preset options: the paper's dense many-scale setup or a lightweight one.
+SLSOptions makeSLSOptions(bool usePaperParams)
 {
-    CV_Assert(dp.cols == numPoints * numSigma);
-    const int D = dp.rows;
-
-    Mat desc(D, numPoints, CV_32F);
-    desc.setTo(0);
-
-    float invNumSigma = 1.0f / static_cast<float>(numSigma);
-
-    for (int i = 0; i < numPoints; ++i) {
-        Mat outCol = desc.col(i);
-        outCol.setTo(0);
-
-        for (int s = 0; s < numSigma; ++s) {
-            int colIdx = s + i * numSigma;
-            outCol += dp.col(colIdx);
-        }
-        outCol *= invNumSigma;
-    }
-
-    return desc;
-}
-
-// Extract SLS-like descriptors for two images.
-SLSOutput extractScalelessDescs(const Mat& I1, const Mat& I2, bool usePaperParams)
-{
-    SLSOutput out;
-
-    if (I1.empty() || I2.empty()) {
-        std::cerr << "extractScalelessDescs: one of the input images is empty.\n";
-        return out;
-    }
-
     SLSOptions opts;
 
     if (usePaperParams) {
@@ -111,8 +76,6 @@ SLSOutput extractScalelessDescs(const Mat& I1, const Mat& I2, bool usePaperParam
         opts.dimReduction = 0;
         opts.dimReductionCov = 50000;
         opts.subsDim = 8;
-
-        std::cout << "[SLS] Using paper-like parameters (dense, many scales).\n";
     }
     else {
         // Lightweight parameters for debugging / development.
@@ -129,39 +92,77 @@ SLSOutput extractScalelessDescs(const Mat& I1, const Mat& I2, bool usePaperParam
         opts.dimReduction = 32;
         opts.dimReductionCov = 20000;
         opts.subsDim = 6;
-
-        std::cout << "[SLS] Using lightweight SLS parameters.\n";
     }
 
-    // Convert to grayscale float [0,1]
-    Mat g1, g2;
+    return opts;
+}
 
-    if (I1.channels() > 1) {
-        cvtColor(I1, g1, COLOR_BGR2GRAY);
+// Extract SLS-like descriptors for two images.
+SLSOutput extractScalelessDescs(const Mat& I1, const Mat& I2, bool usePaperParams)
+{
+    if (usePaperParams) {
+        std::cout << "[SLS] Using paper-like parameters (dense, many scales).\n";
     }
     else {
-        g1 = I1.clone();
+        std::cout << "[SLS] Using lightweight SLS parameters.\n";
     }
 
-    if (I2.channels() > 1) {
-        cvtColor(I2, g2, COLOR_BGR2GRAY);
-    }
-    else {
-        g2 = I2.clone();
+    return extractScalelessDescs(I1, I2, makeSLSOptions(usePaperParams));
+}
+
+// Extract SLS-like descriptors for two images with explicit options.
+SLSOutput extractScalelessDescs(const Mat& I1, const Mat& I2, const SLSOptions& opts)
+{
+    SLSOutput out;
+
+    if (I1.empty() || I2.empty()) {
+        std::cerr << "extractScalelessDescs: one of the input images is empty.\n";
+        return out;
     }
 
-    g1.convertTo(g1, CV_32F, 1.0 / 255.0);
-    g2.convertTo(g2, CV_32F, 1.0 / 255.0);
+    // The joint PCA basis depends on both images, so whole results are
+    // cached per pair; the grids below are cached per image.
+    std::shared_ptr<sls::DescriptorCache> cache = sls::descriptorCache();
+    std::string pairKey;
+    if (cache) {
+        pairKey = sls::DescriptorCache::pairKey(sls::DescriptorCache::imageKey(I1),
+            sls::DescriptorCache::imageKey(I2), opts);
+        if (cache->loadPair(pairKey, out)) {
+            std::cerr << "[SLS] Descriptors loaded from cache.\n";
+            return out;
+        }
+    }
 
-    // --- Dense SIFT descriptors at multiple scales ---
+    // Stay in 8-bit: padForDescriptors converts/pads once and SIFT works on
+    // 8-bit input, so a float [0,1] copy would only be converted back.
     std::cout << "[SLS] Generating dense descriptors for image 1...\n";
-    DescriptorGrid dp1 = generateDescriptors(g1, opts);
+    DescriptorGrid dp1 = generateDescriptors(I1, opts);
     std::cout << "[SLS] ...image 1 descriptors done.\n";
 
     std::cout << "[SLS] Generating dense descriptors for image 2...\n";
-    DescriptorGrid dp2 = generateDescriptors(g2, opts);
+    DescriptorGrid dp2 = generateDescriptors(I2, opts);
     std::cout << "[SLS] ...image 2 descriptors done.\n";
 
+    out = extractScalelessDescs(dp1, dp2, opts);
+    if (cache) {
+        cache->storePair(pairKey, out);
+    }
+    return out;
+}
+
+// SLS reduction of descriptor grids that were already computed with `opts`
+// (e.g. shared with a DSIFT baseline).
+SLSOutput extractScalelessDescs(const DescriptorGrid& dp1,
+    const DescriptorGrid& dp2,
+    const SLSOptions& opts)
+{
+    SLSOutput out;
+
+    if (dp1.dpMat.empty() || dp2.dpMat.empty()) {
+        std::cerr << "extractScalelessDescs: descriptor grids are empty.\n";
+        return out;
+    }
+
     // PCA / dimensionality reduction
     Mat dp1Reduced, dp2Reduced, pcaBasis;
     pcaReduce(dp1.dpMat, dp2.dpMat, opts, dp1Reduced, dp2Reduced, pcaBasis);
@@ -177,6 +178,8 @@ SLSOutput extractScalelessDescs(const Mat& I1, const Mat& I2, bool usePaperParam
 
     out.desc1 = desc1;
     out.desc2 = desc2;
+    out.grid1 = Size(dp1.s1, dp1.s2);
+    out.grid2 = Size(dp2.s1, dp2.s2);
     out.pcaBasis = pcaBasis;
 
     std::cout << "[SLS] Finished extractScalelessDescs.\n";
@@ -0,0 +1,136 @@
+#include "test_common.hpp"
+#include "sls/dense_sift.hpp"
+#include "sls/sls_extractor.hpp"
+#include "sls/memory_plan.hpp"
+#include <opencv2/opencv.hpp>
+
+namespace {
+
+    // Every band of `bandRows` grid rows must reproduce the matching columns
+    // of the whole-image grid exactly.
+    void compareBandsWithWhole(const cv::Mat& img, const SLSOptions& opts, int bandRows)
+    {
+        const PaddedImage pad = padForDescriptors(img, opts);
+        cv::Ptr<cv::SIFT> sift = cv::SIFT::create();
+        const DescriptorGrid whole = generateDescriptors(pad, opts, sift);
+        CHECK(whole.numPoints > 0);
+        if (whole.numPoints == 0) return;
+
+        const int numSigma = static_cast<int>(opts.sigma.size());
+        int covered = 0;
+        for (int r = 0; r < whole.s2; r += bandRows) {
+            const DescriptorGrid band = generateDescriptorRows(pad, opts, sift, r, r + bandRows);
+            CHECK(band.s1 == whole.s1);
+            const int col0 = r * whole.s1 * numSigma;
+            const int cols = band.numPoints * numSigma;
+            CHECK(col0 + cols <= whole.dpMat.cols);
+            if (col0 + cols > whole.dpMat.cols) return;
+            CHECK(slstest::maxAbsDiff(band.dpMat, whole.dpMat.colRange(col0, col0 + cols)) == 0.0);
+            covered += band.s2;
+        }
+        CHECK(covered == whole.s2);
+    }
+}
+
+SLS_TEST(banded_grid_equals_whole_image)
+{
+    const cv::Mat img = slstest::sampleImage("source.jpg", 0.25);
+    if (img.empty()) return;
+
+    SLSOptions opts = makeSLSOptions(false);
+    compareBandsWithWhole(img, opts, 3);
+
+    // Large scales on a fine grid: the descriptor reach (about 80 sigma)
+    // spans many bands.
+    opts.sigma = { 2.0f, 6.0f };
+    opts.gridSpacing = 4;
+    compareBandsWithWhole(img, opts, 2);
+}
+
+SLS_TEST(banded_octave_grid_equals_whole_image)
+{
+    const cv::Mat img = slstest::sampleImage("source.jpg", 0.25);
+    if (img.empty()) return;
+
+    // Scales 2.5 and 4 run on the first and second pyrDown level, where
+    // the band crop has to cover the reach at the octave's own sigma.
+    SLSOptions opts = makeSLSOptions(false);
+    opts.octaveSigma = 1.5f;
+    CHECK(descriptorOctave(opts.sigma.back(), opts) == 2);
+    compareBandsWithWhole(img, opts, 3);
+
+    opts.sigma = { 2.0f, 6.0f };
+    opts.gridSpacing = 4;
+    opts.octaveSigma = 2.0f;
+    compareBandsWithWhole(img, opts, 2);
+}
+
+SLS_TEST(octave_sigma_above_every_scale_equals_off)
+{
+    const cv::Mat img = slstest::sampleImage("source.jpg", 0.25);
+    if (img.empty()) return;
+
+    SLSOptions off = makeSLSOptions(false);
+    SLSOptions high = off;
+    high.octaveSigma = off.sigma.back();
+
+    const PaddedImage padOff = padForDescriptors(img, off);
+    const PaddedImage padHigh = padForDescriptors(img, high);
+    CHECK(padHigh.octaves.empty());
+    CHECK(padHigh.padSize == padOff.padSize);
+
+    const DescriptorGrid a = generateDescriptors(padOff, off, cv::SIFT::create());
+    const DescriptorGrid b = generateDescriptors(padHigh, high, cv::SIFT::create());
+    CHECK(a.s1 == b.s1 && a.s2 == b.s2);
+    CHECK(slstest::maxAbsDiff(a.dpMat, b.dpMat) == 0.0);
+}
+
+SLS_TEST(within_budget_equals_whole_image)
+{
+    const cv::Mat I1 = slstest::sampleImage("source.jpg", 0.25);
+    const cv::Mat I2 = slstest::sampleImage("target.jpg", 0.25);
+    if (I1.empty() || I2.empty()) return;
+
+    SLSOptions opts = makeSLSOptions(false);
+    opts.dimReduction = 16;
+
+    // Tightest budget that still gets a banded plan.
+    sls::MemoryPlanParams params;
+    params.matching = false;
+    const sls::MemoryPlan full = sls::planMemory(opts, I1.size(), I2.size(), params);
+    bool banded = false;
+    for (double f = 0.9; f > 0.05 && !banded; f -= 0.05) {
+        params.budgetBytes = static_cast<size_t>(full.peakBytes * f);
+        const sls::MemoryPlan p = sls::planMemory(opts, I1.size(), I2.size(), params);
+        banded = p.fits && p.tileRows > 0 && p.tileRows < p.grid1.height;
+    }
+    CHECK(banded);
+    if (!banded) return;
+
+    const SLSOutput ref = extractScalelessDescs(I1, I2, opts);
+    const SLSOutput out = sls::extractScalelessDescsWithinBudget(I1, I2, opts, params);
+    CHECK(out.grid1 == ref.grid1 && out.grid2 == ref.grid2);
+    CHECK(out.pcaBasis.size() == ref.pcaBasis.size());
+    CHECK(out.desc1.size() == ref.desc1.size() && out.desc2.size() == ref.desc2.size());
+    if (out.pcaBasis.size() != ref.pcaBasis.size() || out.desc1.size() != ref.desc1.size()
+        || out.desc2.size() != ref.desc2.size()) {
+        return;
+    }
+
+    // Same components up to sign.
+    std::vector<float> sign(out.pcaBasis.rows);
+    for (int k = 0; k < out.pcaBasis.rows; ++k) {
+        const double c = out.pcaBasis.row(k).dot(ref.pcaBasis.row(k));
+        CHECK_NEAR(std::abs(c), 1.0, 1e-3);
+        sign[k] = c < 0.0 ? -1.0f : 1.0f;
+    }
+
+    const cv::Mat* got[2] = { &out.desc1, &out.desc2 };
+    const cv::Mat* want[2] = { &ref.desc1, &ref.desc2 };
+    for (int i = 0; i < 2; ++i) {
+        cv::Mat aligned = got[i]->clone();
+        for (int k = 0; k < aligned.rows; ++k) aligned.row(k) *= sign[k];
+        const double scale = cv::norm(*want[i], cv::NORM_INF);
+        CHECK(slstest::maxAbsDiff(aligned, *want[i]) <= 1e-3 * scale);
+    }
+}
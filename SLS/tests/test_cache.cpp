@@ -0,0 +1,99 @@
+#include "test_common.hpp"
+#include "sls/descriptor_cache.hpp"
+#include "sls/dense_sift.hpp"
+#include "sls/sls_extractor.hpp"
+#include <opencv2/opencv.hpp>
+#include <opencv2/core/utils/filesystem.hpp>
+
+namespace {
+
+    // Cache in a fresh temporary directory (the cache creates it), removed
+    // again on destruction.
+    struct TempCache {
+        sls::CacheParams params;
+        std::unique_ptr<sls::DescriptorCache> cache;
+
+        TempCache()
+        {
+            params.dir = cv::tempfile("slscache");
+            cache.reset(new sls::DescriptorCache(params));
+        }
+
+        ~TempCache()
+        {
+            cache.reset();
+            cv::utils::fs::remove_all(params.dir);
+        }
+    };
+}
+
+SLS_TEST(cache_round_trips_entries)
+{
+    const cv::Mat I1 = slstest::sampleImage("source.jpg", 0.2);
+    const cv::Mat I2 = slstest::sampleImage("target.jpg", 0.2);
+    if (I1.empty() || I2.empty()) return;
+
+    SLSOptions opts = makeSLSOptions(false);
+    opts.dimReduction = 16;
+    TempCache tc;
+    sls::DescriptorCache& cache = *tc.cache;
+    const std::string key1 = sls::DescriptorCache::imageKey(I1);
+    const std::string key2 = sls::DescriptorCache::imageKey(I2);
+
+    const DescriptorGrid grid = generateDescriptors(padForDescriptors(I1, opts), opts, cv::SIFT::create());
+    const std::string gk = sls::DescriptorCache::gridKey(key1, opts);
+    DescriptorGrid gridBack;
+    CHECK(!cache.loadGrid(gk, gridBack));
+    cache.storeGrid(gk, grid);
+    CHECK(cache.loadGrid(gk, gridBack));
+    CHECK(gridBack.numPoints == grid.numPoints && gridBack.s1 == grid.s1 && gridBack.s2 == grid.s2);
+    CHECK(slstest::maxAbsDiff(gridBack.dpMat, grid.dpMat) == 0.0);
+
+    const SLSOutput out = extractScalelessDescs(I1, I2, opts);
+    const std::string pk = sls::DescriptorCache::pairKey(key1, key2, opts);
+    SLSOutput outBack;
+    cache.storePair(pk, out);
+    CHECK(cache.loadPair(pk, outBack));
+    CHECK(outBack.grid1 == out.grid1 && outBack.grid2 == out.grid2);
+    CHECK(slstest::maxAbsDiff(outBack.desc1, out.desc1) == 0.0);
+    CHECK(slstest::maxAbsDiff(outBack.desc2, out.desc2) == 0.0);
+    CHECK(slstest::maxAbsDiff(outBack.pcaBasis, out.pcaBasis) == 0.0);
+
+    const std::string dk = sls::DescriptorCache::descKey(key1, opts, sls::DescriptorCache::basisKey(out.pcaBasis));
+    cv::Mat descBack;
+    cv::Size gridSize;
+    cache.storeDesc(dk, out.desc1, out.grid1);
+    CHECK(cache.loadDesc(dk, descBack, gridSize));
+    CHECK(gridSize == out.grid1);
+    CHECK(slstest::maxAbsDiff(descBack, out.desc1) == 0.0);
+
+    const sls::CacheStats st = cache.stats();
+    CHECK(st.entries == 3);
+    CHECK(st.hits == 3 && st.misses == 1);
+}
+
+SLS_TEST(cache_keys_cover_options_and_sift)
+{
+    const cv::Mat I1 = slstest::sampleImage("source.jpg", 0.2);
+    if (I1.empty()) return;
+
+    const SLSOptions opts = makeSLSOptions(false);
+    const std::string image = sls::DescriptorCache::imageKey(I1);
+    const std::string base = sls::DescriptorCache::gridKey(image, opts);
+
+    // An explicit default SIFT is the same extractor as none.
+    CHECK(sls::DescriptorCache::gridKey(image, opts, cv::SIFT::create()) == base);
+    CHECK(sls::DescriptorCache::gridKey(image, opts, cv::SIFT::create(0, 3, 0.04, 10, 2.0)) != base);
+    CHECK(sls::DescriptorCache::gridKey(image, opts, cv::SIFT::create(0, 4)) != base);
+
+    SLSOptions other = opts;
+    other.gridSpacing += 1;
+    CHECK(sls::DescriptorCache::gridKey(image, other) != base);
+    other = opts;
+    other.sigma.back() += 0.5f;
+    CHECK(sls::DescriptorCache::gridKey(image, other) != base);
+
+    cv::Mat changed = I1.clone();
+    changed.at<uchar>(0, 0) ^= 1;
+    CHECK(sls::DescriptorCache::gridKey(sls::DescriptorCache::imageKey(changed), opts) != base);
+}
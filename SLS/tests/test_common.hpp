@@ -0,0 +1,57 @@
+#pragma once
+// Minimal self-registering test harness for sls_tests. Each SLS_TEST body
+// runs once; CHECK records a failure and continues.
+#include <opencv2/core.hpp>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace slstest {
+
+    struct TestCase {
+        const char* name;
+        void (*fn)();
+    };
+
+    std::vector<TestCase>& registry();
+    int& failures();
+
+    // Directory holding the sample images (source.jpg, target.jpg).
+    const std::string& dataDir();
+
+    // A sample image ("source.jpg" or "target.jpg") as 8-bit grayscale,
+    // scaled by `scale`; empty (and counted as a failure) if missing.
+    cv::Mat sampleImage(const char* name, double scale);
+
+    struct Register {
+        Register(const char* name, void (*fn)()) { registry().push_back(TestCase{ name, fn }); }
+    };
+
+    // Largest absolute difference between two matrices of the same size and
+    // type; infinity if they differ in size or type.
+    double maxAbsDiff(const cv::Mat& a, const cv::Mat& b);
+}
+
+#define SLS_TEST(name) \
+    static void name(); \
+    static slstest::Register name##_registration(#name, name); \
+    static void name()
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            ++slstest::failures(); \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed\n"; \
+        } \
+    } while (0)
+
+#define CHECK_NEAR(a, b, tol) \
+    do { \
+        const double va = (a), vb = (b); \
+        if (!(std::abs(va - vb) <= (tol))) { \
+            ++slstest::failures(); \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK_NEAR(" #a ", " #b ") failed: " \
+                << va << " vs " << vb << " (tol " << (tol) << ")\n"; \
+        } \
+    } while (0)
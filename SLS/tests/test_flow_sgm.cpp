@@ -0,0 +1,51 @@
+#include "test_common.hpp"
+#include "sls/flow_sgm.hpp"
+#include <opencv2/opencv.hpp>
+
+namespace {
+
+    // Random C-channel descriptor image and a copy shifted right by `shift`
+    // columns, so the true flow is (shift, 0) wherever x + shift < W.
+    void shiftedPair(cv::RNG& rng, int H, int W, int C, float hi, int shift, cv::Mat& src, cv::Mat& dst)
+    {
+        src.create(H, W, CV_32FC(C));
+        rng.fill(src, cv::RNG::UNIFORM, 0.0f, hi);
+        dst.create(H, W, CV_32FC(C));
+        rng.fill(dst, cv::RNG::UNIFORM, 0.0f, hi);
+        src.colRange(0, W - shift).copyTo(dst.colRange(shift, W));
+    }
+
+    void checkShift(const cv::Mat& flow, int shift)
+    {
+        CHECK(!flow.empty());
+        if (flow.empty()) return;
+        int wrong = 0;
+        for (int y = 0; y < flow.rows; ++y) {
+            for (int x = 0; x + shift < flow.cols; ++x) {
+                const cv::Vec2f f = flow.at<cv::Vec2f>(y, x);
+                if (f[0] != static_cast<float>(shift) || f[1] != 0.0f) ++wrong;
+            }
+        }
+        CHECK(wrong == 0);
+    }
+}
+
+SLS_TEST(sgm_recovers_shift_with_large_costs)
+{
+    // Costs far above SIFT range: the quantised sums sit at the top of the
+    // 16-bit range, where out-of-image labels near the border used to wrap
+    // around to the cheapest candidate.
+    cv::RNG rng(5);
+    cv::Mat src, dst;
+    shiftedPair(rng, 24, 32, 16, 1.0e4f, 2, src, dst);
+
+    sls::SGMParams params;
+    checkShift(sls::computeDenseFlowSGM(src, dst, params), 2);
+
+    params.P1 = 1.0e4f;
+    params.P2 = 1.0e5f;
+    checkShift(sls::computeDenseFlowSGM(src, dst, params), 2);
+
+    params.numPaths = 4;
+    checkShift(sls::computeDenseFlowSGM(src, dst, params), 2);
+}
@@ -0,0 +1,109 @@
+// Test runner: sls_tests [--data DIR] [name-substring...]
+// Runs every registered test (or those whose name contains one of the given
+// substrings) and returns non-zero if any CHECK failed. The sample images are
+// looked up in DIR, $SLS_TEST_DATA, ../data and data, in that order.
+#include "test_common.hpp"
+#include <opencv2/opencv.hpp>
+#include <opencv2/core/utils/filesystem.hpp>
+#include <cstdlib>
+#include <limits>
+
+namespace slstest {
+
+    namespace {
+        std::string& dataDirStorage()
+        {
+            static std::string dir;
+            return dir;
+        }
+    }
+
+    std::vector<TestCase>& registry()
+    {
+        static std::vector<TestCase> tests;
+        return tests;
+    }
+
+    int& failures()
+    {
+        static int count = 0;
+        return count;
+    }
+
+    const std::string& dataDir()
+    {
+        return dataDirStorage();
+    }
+
+    cv::Mat sampleImage(const char* name, double scale)
+    {
+        cv::Mat img = cv::imread(cv::utils::fs::join(dataDir(), name), cv::IMREAD_GRAYSCALE);
+        if (img.empty()) {
+            std::cerr << "sample image " << name << " not found in '" << dataDir() << "'\n";
+            ++failures();
+            return img;
+        }
+        if (scale != 1.0) {
+            cv::resize(img, img, cv::Size(), scale, scale, cv::INTER_AREA);
+        }
+        return img;
+    }
+
+    double maxAbsDiff(const cv::Mat& a, const cv::Mat& b)
+    {
+        if (a.size() != b.size() || a.type() != b.type()) {
+            return std::numeric_limits<double>::infinity();
+        }
+        if (a.empty()) return 0.0;
+        return cv::norm(a, b, cv::NORM_INF);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> filters;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--data" && i + 1 < argc) {
+            slstest::dataDirStorage() = argv[++i];
+        }
+        else {
+            filters.push_back(arg);
+        }
+    }
+
+    if (slstest::dataDir().empty()) {
+        const char* env = std::getenv("SLS_TEST_DATA");
+        const char* candidates[] = { env, "../data", "data" };
+        for (const char* c : candidates) {
+            if (c && cv::utils::fs::exists(cv::utils::fs::join(c, "source.jpg"))) {
+                slstest::dataDirStorage() = c;
+                break;
+            }
+        }
+    }
+
+    int run = 0;
+    for (const slstest::TestCase& t : slstest::registry()) {
+        bool selected = filters.empty();
+        for (const std::string& f : filters) {
+            if (std::string(t.name).find(f) != std::string::npos) selected = true;
+        }
+        if (!selected) continue;
+
+        const int before = slstest::failures();
+        std::cout << "[TEST] " << t.name << std::flush;
+        try {
+            t.fn();
+        }
+        catch (const std::exception& e) {
+            ++slstest::failures();
+            std::cerr << "\n" << t.name << ": exception: " << e.what() << "\n";
+        }
+        std::cout << (slstest::failures() == before ? " ok" : " FAILED") << std::endl;
+        ++run;
+    }
+
+    std::cout << "[TEST] " << run << " tests, " << slstest::failures() << " failed checks." << std::endl;
+    return slstest::failures() == 0 ? 0 : 1;
+}
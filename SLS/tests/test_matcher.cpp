@@ -0,0 +1,84 @@
+#include "test_common.hpp"
+#include "sls/matcher.hpp"
+#include <opencv2/opencv.hpp>
+
+namespace {
+
+    // D x N descriptors, as in SLSOutput.
+    cv::Mat randomDescriptors(cv::RNG& rng, int D, int N, float hi)
+    {
+        cv::Mat d(D, N, CV_32F);
+        rng.fill(d, cv::RNG::UNIFORM, 0.0f, hi);
+        return d;
+    }
+
+    void compareWithBFMatcher(const cv::Mat& desc1, const cv::Mat& desc2,
+        const sls::MatcherParams& params = sls::MatcherParams())
+    {
+        std::vector<cv::DMatch> ours = sls::matchDescriptors(desc1, desc2, params);
+
+        std::vector<cv::DMatch> ref;
+        cv::BFMatcher bf(cv::NORM_L2, true);
+        bf.match(desc1.t(), desc2.t(), ref);
+
+        CHECK(ours.size() == ref.size());
+        if (ours.size() != ref.size()) return;
+
+        // BFMatcher also reports mutual matches in query order.
+        for (size_t m = 0; m < ref.size(); ++m) {
+            CHECK(ours[m].queryIdx == ref[m].queryIdx);
+            CHECK(ours[m].trainIdx == ref[m].trainIdx);
+            CHECK_NEAR(ours[m].distance, ref[m].distance, 1e-4 * (1.0 + ref[m].distance));
+        }
+    }
+}
+
+SLS_TEST(matcher_equals_bfmatcher_unit_range)
+{
+    cv::RNG rng(7);
+    compareWithBFMatcher(randomDescriptors(rng, 32, 700, 1.0f), randomDescriptors(rng, 32, 900, 1.0f));
+}
+
+SLS_TEST(matcher_equals_bfmatcher_sift_range)
+{
+    // SIFT-sized values make |a|^2 large relative to neighbour gaps, which
+    // is where the expanded distance form loses precision.
+    cv::RNG rng(11);
+    compareWithBFMatcher(randomDescriptors(rng, 128, 1500, 255.0f), randomDescriptors(rng, 128, 1200, 255.0f));
+}
+
+SLS_TEST(matcher_single_band_equals_bfmatcher)
+{
+    // No scratch budget: one band, whatever the thread count.
+    sls::MatcherParams params;
+    params.scratchMB = 0;
+    cv::RNG rng(13);
+    compareWithBFMatcher(randomDescriptors(rng, 32, 700, 1.0f), randomDescriptors(rng, 32, 900, 1.0f), params);
+}
+
+SLS_TEST(matcher_ratio_test)
+{
+    cv::RNG rng(3);
+    cv::Mat desc1 = randomDescriptors(rng, 16, 300, 1.0f);
+    cv::Mat desc2 = randomDescriptors(rng, 16, 400, 1.0f);
+
+    sls::MatcherParams params;
+    params.mutual = false;
+    params.ratio = 0.8f;
+    std::vector<cv::DMatch> ours = sls::matchDescriptors(desc1, desc2, params);
+
+    std::vector<std::vector<cv::DMatch> > knn;
+    cv::BFMatcher bf(cv::NORM_L2, false);
+    bf.knnMatch(desc1.t(), desc2.t(), knn, 2);
+
+    std::vector<cv::DMatch> ref;
+    for (const auto& k : knn) {
+        if (k.size() == 2 && k[0].distance < 0.8f * k[1].distance) ref.push_back(k[0]);
+    }
+
+    CHECK(ours.size() == ref.size());
+    for (size_t m = 0; m < std::min(ours.size(), ref.size()); ++m) {
+        CHECK(ours[m].queryIdx == ref[m].queryIdx);
+        CHECK(ours[m].trainIdx == ref[m].trainIdx);
+    }
+}
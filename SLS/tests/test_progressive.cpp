@@ -0,0 +1,70 @@
+#include "test_common.hpp"
+#include "sls/progressive.hpp"
+#include "sls/sls_extractor.hpp"
+#include <opencv2/opencv.hpp>
+#include <stdexcept>
+
+namespace {
+
+    // The final level must reproduce extractScalelessDescs exactly: reused
+    // coarse-level descriptors, partial point sets and the per-level crops
+    // all have to agree with the whole-image grid.
+    void compareFinalLevel(const SLSOptions& opts, const sls::ProgressiveParams& params)
+    {
+        const cv::Mat I1 = slstest::sampleImage("source.jpg", 0.25);
+        const cv::Mat I2 = slstest::sampleImage("target.jpg", 0.25);
+        if (I1.empty() || I2.empty()) return;
+
+        int reported = 0;
+        sls::ProgressiveExtractor progressive(I1, I2, opts, params,
+            [&](const sls::ProgressiveResult&) { ++reported; });
+        const sls::ProgressiveResult res = progressive.finalResult().get();
+        const SLSOutput ref = extractScalelessDescs(I1, I2, opts);
+
+        CHECK(res.final);
+        CHECK(reported >= 1);
+        CHECK(res.output.grid1 == ref.grid1 && res.output.grid2 == ref.grid2);
+        CHECK(slstest::maxAbsDiff(res.output.desc1, ref.desc1) == 0.0);
+        CHECK(slstest::maxAbsDiff(res.output.desc2, ref.desc2) == 0.0);
+        CHECK(slstest::maxAbsDiff(res.output.pcaBasis, ref.pcaBasis) == 0.0);
+    }
+}
+
+SLS_TEST(progressive_final_equals_extract_nested)
+{
+    SLSOptions opts = makeSLSOptions(false);
+    opts.gridSpacing = 4;
+    compareFinalLevel(opts, sls::ProgressiveParams());
+}
+
+SLS_TEST(progressive_final_equals_extract_not_nested)
+{
+    SLSOptions opts = makeSLSOptions(false);
+    opts.gridSpacing = 4;
+    sls::ProgressiveParams params;
+    params.levels.clear();
+    params.levels.push_back(sls::ProgressiveLevel(3, 0.5f));   // implied final (1, 1.0)
+    compareFinalLevel(opts, params);
+}
+
+SLS_TEST(progressive_callback_exception_reaches_future)
+{
+    const cv::Mat I1 = slstest::sampleImage("source.jpg", 0.25);
+    const cv::Mat I2 = slstest::sampleImage("target.jpg", 0.25);
+    if (I1.empty() || I2.empty()) return;
+
+    SLSOptions opts = makeSLSOptions(false);
+    opts.gridSpacing = 4;
+    sls::ProgressiveExtractor progressive(I1, I2, opts, sls::ProgressiveParams(),
+        [](const sls::ProgressiveResult&) { throw std::runtime_error("callback failed"); });
+
+    bool thrown = false;
+    try {
+        progressive.finalResult().get();
+    }
+    catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    CHECK(progressive.done());
+}
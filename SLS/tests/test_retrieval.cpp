@@ -0,0 +1,81 @@
+#include "test_common.hpp"
+#include "sls/retrieval.hpp"
+#include "sls/sls_extractor.hpp"
+#include <opencv2/opencv.hpp>
+
+namespace {
+
+    // A few distinct references built from the two sample images.
+    std::vector<cv::Mat> referenceImages()
+    {
+        std::vector<cv::Mat> images;
+        const cv::Mat source = slstest::sampleImage("source.jpg", 0.2);
+        const cv::Mat target = slstest::sampleImage("target.jpg", 0.2);
+        if (source.empty() || target.empty()) return images;
+        cv::Mat flipped, rotated;
+        cv::flip(source, flipped, 1);
+        cv::rotate(target, rotated, cv::ROTATE_90_CLOCKWISE);
+        images.push_back(source);
+        images.push_back(target);
+        images.push_back(flipped);
+        images.push_back(rotated);
+        return images;
+    }
+
+    sls::VocabularyParams smallVocabulary()
+    {
+        sls::VocabularyParams params;
+        params.branching = 6;
+        params.levels = 2;
+        params.pcaDim = 16;
+        params.maxTrainSamples = 20000;
+        return params;
+    }
+}
+
+SLS_TEST(retrieval_finds_each_reference_first)
+{
+    const std::vector<cv::Mat> images = referenceImages();
+    if (images.empty()) return;
+
+    const SLSOptions opts = makeSLSOptions(false);
+    std::vector<cv::Mat> desc;
+    for (const cv::Mat& img : images) desc.push_back(sls::describeImage(img, opts));
+
+    sls::RetrievalIndex index;
+    CHECK(index.train(desc, opts, smallVocabulary()));
+    for (size_t i = 0; i < desc.size(); ++i) index.add(desc[i], "ref" + std::to_string(i));
+    index.finalize();
+
+    for (size_t i = 0; i < desc.size(); ++i) {
+        const std::vector<sls::RetrievalHit> hits = index.query(desc[i], 2);
+        CHECK(!hits.empty());
+        if (hits.empty()) continue;
+        CHECK(hits[0].image == static_cast<int>(i));
+        CHECK_NEAR(hits[0].score, 1.0, 1e-4);
+    }
+}
+
+SLS_TEST(retrieval_single_reference_index)
+{
+    // With one reference every word is in all references; the smoothed
+    // idf keeps the vectors non-zero.
+    const std::vector<cv::Mat> images = referenceImages();
+    if (images.empty()) return;
+
+    const SLSOptions opts = makeSLSOptions(false);
+    const cv::Mat desc = sls::describeImage(images[0], opts);
+
+    sls::RetrievalIndex index;
+    CHECK(index.train(std::vector<cv::Mat>(1, desc), opts, smallVocabulary()));
+    index.add(desc, "only");
+    index.finalize();
+
+    const std::vector<sls::RetrievalHit> hits = index.query(desc, 5);
+    CHECK(hits.size() == 1);
+    if (hits.size() == 1) {
+        CHECK(hits[0].name == "only");
+        CHECK(std::isfinite(hits[0].score));
+        CHECK_NEAR(hits[0].score, 1.0, 1e-4);
+    }
+}
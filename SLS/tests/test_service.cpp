@@ -0,0 +1,76 @@
+#include "test_common.hpp"
+#include "sls/extraction_service.hpp"
+#include <opencv2/opencv.hpp>
+
+namespace {
+
+    const char* const kOptions =
+        "%YAML:1.0\n"
+        "scaleFactor: 1\n"
+        "sls: { preset: light, dimReduction: 16 }\n"
+        "flow: { enabled: 0 }\n";
+
+    bool makeRequest(sls::ServiceRequest& req, const std::string& options)
+    {
+        const cv::Mat I1 = slstest::sampleImage("source.jpg", 0.2);
+        const cv::Mat I2 = slstest::sampleImage("target.jpg", 0.2);
+        if (I1.empty() || I2.empty()) return false;
+        req.options = options;
+        cv::imencode(".png", I1, req.image1);
+        cv::imencode(".png", I2, req.image2);
+        return true;
+    }
+}
+
+SLS_TEST(service_submit_returns_descriptors)
+{
+    sls::ServiceRequest req;
+    if (!makeRequest(req, kOptions)) return;
+
+    sls::ServiceParams params;
+    sls::ExtractionService service(params);
+    const sls::ServiceReply a = service.submit(req);
+    CHECK(a.ok);
+    CHECK(a.error.empty());
+    CHECK(a.desc1.rows == 16 && a.desc1.cols == a.grid1.area());
+    CHECK(a.desc2.rows == 16 && a.desc2.cols == a.grid2.area());
+    CHECK(a.pcaBasis.rows == 16);
+    CHECK(a.batchSize == 1);
+
+    // The basis is frozen after the first batch, so a repeat is identical.
+    const sls::ServiceReply b = service.submit(req);
+    CHECK(b.ok);
+    CHECK(slstest::maxAbsDiff(b.pcaBasis, a.pcaBasis) == 0.0);
+    CHECK(slstest::maxAbsDiff(b.desc1, a.desc1) == 0.0);
+    service.stop();
+}
+
+SLS_TEST(service_survives_failing_requests)
+{
+    sls::ServiceRequest good;
+    if (!makeRequest(good, kOptions)) return;
+
+    sls::ServiceParams params;
+    sls::ExtractionService service(params);
+
+    sls::ServiceRequest garbage = good;
+    garbage.image2.assign(64, 0x5a);
+    const sls::ServiceReply undecodable = service.submit(garbage);
+    CHECK(!undecodable.ok);
+    CHECK(!undecodable.error.empty());
+
+    // computeDenseFlowSGM rejects a negative radius with an exception on
+    // the dispatcher thread; the client still gets an error reply.
+    sls::ServiceRequest throwing = good;
+    throwing.options =
+        "%YAML:1.0\n"
+        "scaleFactor: 1\n"
+        "flow: { enabled: 1, regularize: 1, windowRadius: -1 }\n";
+    const sls::ServiceReply failed = service.submit(throwing);
+    CHECK(!failed.ok);
+    CHECK(failed.error.find("processing failed") != std::string::npos);
+
+    const sls::ServiceReply after = service.submit(good);
+    CHECK(after.ok);
+    service.stop();
+}